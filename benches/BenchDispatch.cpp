@@ -0,0 +1,67 @@
+#include <Protocon/StaticGateway.h>
+#include <benchmark/benchmark.h>
+
+#include <unordered_map>
+
+// Cost per message of finding and calling the handler of a request, the
+// way Gateway::poll() does with handler maps and with a StaticGateway
+
+static Protocon::Response Handle(const Protocon::Request& r) {
+    return Protocon::Response{r.time, static_cast<uint8_t>(r.type), ""};
+}
+
+static const uint16_t Types[] = {0x0001, 0x0004, 0x0002, 0x0008, 0x0003, 0x0007, 0x0005, 0x0006};
+
+static void BenchDispatchMap(benchmark::State& state) {
+    std::unordered_map<uint16_t, Protocon::RequestHandler> handlers;
+    for (uint16_t type = 0x0001; type <= 0x0008; type++)
+        handlers.emplace(type, [](Protocon::ClientToken, const Protocon::Request& r) { return Handle(r); });
+
+    Protocon::Request request{0, 0, ""};
+    std::size_t i = 0;
+    for (auto _ : state) {
+        request.type = Types[i++ & 7];
+        auto it = handlers.find(request.type);
+        Protocon::Response response = it->second(Protocon::ClientToken{0}, request);
+        benchmark::DoNotOptimize(response);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BenchDispatchMap);
+
+// Same as the thunk StaticGateway hands to the gateway
+template <typename Dispatcher>
+static void Dispatch(void* dispatcher, Protocon::ClientToken tk, const Protocon::Request& r, Protocon::Response& response) {
+    static_cast<Dispatcher*>(dispatcher)->dispatch(tk, r, response);
+}
+
+static void BenchDispatchStatic(benchmark::State& state) {
+    auto handler = [](Protocon::ClientToken, const Protocon::Request& r) { return Handle(r); };
+    using H = decltype(handler);
+    using D1 = Protocon::StaticDispatcher<0x0001, H, Protocon::StaticDispatchEnd>;
+    using D2 = Protocon::StaticDispatcher<0x0002, H, D1>;
+    using D3 = Protocon::StaticDispatcher<0x0003, H, D2>;
+    using D4 = Protocon::StaticDispatcher<0x0004, H, D3>;
+    using D5 = Protocon::StaticDispatcher<0x0005, H, D4>;
+    using D6 = Protocon::StaticDispatcher<0x0006, H, D5>;
+    using D7 = Protocon::StaticDispatcher<0x0007, H, D6>;
+    using D8 = Protocon::StaticDispatcher<0x0008, H, D7>;
+    D8 dispatcher(handler, D7(handler, D6(handler, D5(handler, D4(handler, D3(handler, D2(handler, D1(handler, Protocon::StaticDispatchEnd()))))))));
+
+    // Called through a function pointer, as from Gateway::poll()
+    void (*dispatch)(void*, Protocon::ClientToken, const Protocon::Request&, Protocon::Response&) = &Dispatch<D8>;
+    bool (*handles)(uint16_t) = &D8::Handles;
+    benchmark::DoNotOptimize(dispatch);
+    benchmark::DoNotOptimize(handles);
+
+    Protocon::Request request{0, 0, ""};
+    Protocon::Response response;
+    std::size_t i = 0;
+    for (auto _ : state) {
+        request.type = Types[i++ & 7];
+        if (handles(request.type)) dispatch(&dispatcher, Protocon::ClientToken{0}, request, response);
+        benchmark::DoNotOptimize(response);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BenchDispatchStatic);
@@ -0,0 +1,33 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "RawCommand.h"
+#include "SpillQueue.h"
+
+// Spills a backlog of requests, then drains it back
+static void BenchSpillQueue(benchmark::State& state) {
+    constexpr int Backlog = 1024;
+
+    Protocon::SpillQueue spill("BenchSpill", 16 << 20);
+    if (!spill.open()) {
+        state.SkipWithError("Failed to open spill directory");
+        return;
+    }
+
+    Protocon::RawRequest request{1, 2, 3, 4, Protocon::Request{0, 0x0001, std::string(state.range(0), 'x')}};
+    Protocon::RawRequest r;
+
+    for (auto _ : state) {
+        for (int i = 0; i < Backlog; i++)
+            spill.push(request);
+        for (int i = 0; i < Backlog; i++)
+            spill.pop(r);
+        benchmark::DoNotOptimize(r.request.data.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * Backlog);
+    state.SetBytesProcessed(state.iterations() * Backlog * request.request.data.size());
+}
+
+BENCHMARK(BenchSpillQueue)->Arg(64)->Arg(4 << 10)->Arg(64 << 10);
@@ -0,0 +1,152 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <asio/buffer.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/write.hpp>
+#include <thread>
+#include <vector>
+
+#include "Socket.h"
+
+#ifdef PROTOCON_IO_URING
+#include "UringTransport.h"
+#endif
+
+#ifdef __linux__
+#include "ShmTransport.h"
+#endif
+
+// Loopback peer which either discards everything it receives or keeps
+// sending until the connection is closed
+class Peer {
+  public:
+    enum Mode {
+        Sink,
+        Source,
+    };
+
+    Peer(Mode mode)
+        : mAcceptor(mContext, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)),
+          mSocket(mContext) {
+        mHandle = std::thread([this, mode] {
+            asio::error_code ec;
+            mAcceptor.accept(mSocket, ec);
+
+            std::array<char, 64 << 10> buf{};
+            while (!ec) {
+                if (mode == Sink)
+                    mSocket.read_some(asio::buffer(buf), ec);
+                else
+                    asio::write(mSocket, asio::buffer(buf), ec);
+            }
+        });
+    }
+
+    ~Peer() { mHandle.join(); }
+
+    uint16_t port() const { return mAcceptor.local_endpoint().port(); }
+
+  private:
+    asio::io_context mContext;
+    asio::ip::tcp::acceptor mAcceptor;
+    asio::ip::tcp::socket mSocket;
+    std::thread mHandle;
+};
+
+template <typename T>
+static void BenchTransportWrite(benchmark::State& state) {
+    Peer peer(Peer::Sink);
+    T transport;
+    if (!transport.connect("127.0.0.1", peer.port())) {
+        state.SkipWithError("Failed to connect");
+        return;
+    }
+
+    std::vector<char> buf(state.range(0));
+    for (auto _ : state)
+        if (!transport.write(buf.data(), buf.size(), false)) {
+            state.SkipWithError("Failed to write");
+            break;
+        }
+
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+// Moves a fixed amount of data per iteration through reads of the size the
+// Receiver uses. Counting read() calls instead would compare a memcpy out of
+// io_uring's buffers with a syscall per call.
+template <typename T>
+static void BenchTransportRead(benchmark::State& state) {
+    Peer peer(Peer::Source);
+    T transport;
+    if (!transport.connect("127.0.0.1", peer.port())) {
+        state.SkipWithError("Failed to connect");
+        return;
+    }
+
+    const std::size_t chunk = state.range(0);
+    std::vector<char> buf(64 << 10);
+    for (auto _ : state) {
+        for (std::size_t n = 0; n < chunk;) {
+            std::size_t len = transport.read(buf.data(), std::min(buf.size(), chunk - n));
+            if (!len) {
+                state.SkipWithError("Failed to read");
+                return;
+            }
+            n += len;
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * chunk);
+}
+
+// io_uring does its work on a kernel thread, which the benchmark thread's CPU
+// time doesn't include, so all of them are timed by the wall clock
+BENCHMARK_TEMPLATE(BenchTransportWrite, Protocon::Socket)->Arg(64)->Arg(4 << 10)->Arg(64 << 10)->UseRealTime();
+BENCHMARK_TEMPLATE(BenchTransportRead, Protocon::Socket)->Arg(64 << 10)->Arg(1 << 20)->UseRealTime();
+
+#ifdef PROTOCON_IO_URING
+BENCHMARK_TEMPLATE(BenchTransportWrite, Protocon::UringTransport)->Arg(64)->Arg(4 << 10)->Arg(64 << 10)->UseRealTime();
+BENCHMARK_TEMPLATE(BenchTransportRead, Protocon::UringTransport)->Arg(64 << 10)->Arg(1 << 20)->UseRealTime();
+#endif
+
+#ifdef __linux__
+static void BenchShmTransportWrite(benchmark::State& state) {
+    Protocon::ShmTransport server;
+    if (!server.listen("/protocon-bench")) {
+        state.SkipWithError("Failed to listen");
+        return;
+    }
+
+    std::thread sink([&server] {
+        server.accept();
+        std::array<char, 64 << 10> buf;
+        while (server.read(buf.data(), buf.size()))
+            ;
+    });
+
+    Protocon::ShmTransport transport;
+    if (!transport.connect("/protocon-bench", 0)) {
+        server.shutdown();
+        sink.join();
+        state.SkipWithError("Failed to connect");
+        return;
+    }
+
+    std::vector<char> buf(state.range(0));
+    for (auto _ : state)
+        if (!transport.write(buf.data(), buf.size(), false)) {
+            state.SkipWithError("Failed to write");
+            break;
+        }
+
+    transport.shutdown();
+    sink.join();
+
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+BENCHMARK(BenchShmTransportWrite)->Arg(64)->Arg(4 << 10)->Arg(64 << 10)->UseRealTime();
+#endif
@@ -5,7 +5,11 @@ target("Benches")
     set_default(false)
     add_deps("Protocon")
     add_files("*.cpp")
+    add_includedirs("$(projectdir)/src")
+    if is_plat("linux") then
+        add_options("io_uring")
+    end
     if is_plat("windows") then
         add_ldflags("/subsystem:console")
     end
-    add_packages("benchmark")
+    add_packages("benchmark", "asio", "spdlog")
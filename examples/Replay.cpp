@@ -0,0 +1,119 @@
+#include <Protocon/Protocon.h>
+#include <Protocon/Replay.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+// Usage: Replay <capture file> [--fast] [--unix | --shm] [--busy-poll] [--batch] [--trace <json file>]
+// Captures are recorded with GatewayBuilder::withCapture()
+int main(int argc, char** argv) {
+    if (argc < 2) return 1;
+
+    bool realtime = true;
+    auto transport = Protocon::TransportType::Asio;
+    bool busyPoll = false;
+    bool batch = false;
+    const char* tracePath = nullptr;
+    for (int i = 2; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--fast"))
+            realtime = false;
+        else if (!std::strcmp(argv[i], "--unix"))
+            transport = Protocon::TransportType::Unix;
+        else if (!std::strcmp(argv[i], "--shm"))
+            transport = Protocon::TransportType::SharedMemory;
+        else if (!std::strcmp(argv[i], "--busy-poll"))
+            busyPoll = true;
+        else if (!std::strcmp(argv[i], "--batch"))
+            batch = true;
+        else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+            tracePath = argv[++i];
+    }
+
+    const char* host = "127.0.0.1";
+    const uint16_t port = 8083;
+
+    std::size_t handled = 0;
+
+    // Register the same handlers as the gateway the capture came from
+    Protocon::GatewayBuilder builder(2);
+    if (tracePath) builder.withTracing();
+    if (batch) {
+        // The replay server reads batch frames, so the responses can go back
+        // in them too
+        Protocon::TransportProfile profile;
+        profile.batchFrames = true;
+        builder.withTransportProfile(profile);
+    }
+    if (busyPoll) {
+        Protocon::ThreadOptions receiver;
+        receiver.name = "replay-rx";
+        receiver.busyPoll = true;
+        Protocon::ThreadOptions sender;
+        sender.name = "replay-tx";
+        sender.busyPoll = true;
+        builder.withReceiverThread(receiver).withSenderThread(sender);
+    }
+
+    auto gateway =
+        builder
+            .withRequestHandler(0x0001, [&handled](Protocon::ClientToken tk, const Protocon::Request& r) {
+                handled++;
+                return Protocon::Response{
+                    static_cast<uint64_t>(time(nullptr)),
+                    0x00,
+                    "{}",
+                };
+            })
+            .withTransport(transport)
+            .build();
+
+    // Anonymous tokens pick up the client IDs from the replayed sign up responses
+    for (int i = 0; i < 16; i++)
+        gateway.createClientToken();
+
+    Protocon::Replay replay(argv[1]);
+    bool listening;
+    if (transport == Protocon::TransportType::Unix) {
+        host = "/tmp/protocon-replay.sock";
+        listening = replay.listenUnix(host);
+    } else if (transport == Protocon::TransportType::SharedMemory) {
+        host = "/protocon-replay";
+        listening = replay.listenSharedMemory(host);
+    } else {
+        listening = replay.listen(port);
+    }
+    if (!listening) return 1;
+
+    std::size_t frames = 0;
+    std::thread server([&] { frames = replay.serve(realtime, batch); });
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (!gateway.run(host, port)) {
+        replay.close();
+        server.join();
+        return 1;
+    }
+
+    while (gateway.isOpen())
+        gateway.poll();
+    gateway.poll();
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    gateway.stop();
+    server.join();
+
+    spdlog::info("Replayed {} frames in {:.3f}s, {:.0f} frames/s, {} requests handled", frames, elapsed, frames / elapsed, handled);
+
+    if (tracePath) {
+        gateway.writeTrace(tracePath);
+        for (const auto& h : gateway.traceHistograms())
+            spdlog::info("{}: {} samples, p50 {}ns, p99 {}ns, p99.9 {}ns, max {}ns", h.hop, h.count, h.p50, h.p99, h.p999, h.max);
+    }
+
+    return 0;
+}
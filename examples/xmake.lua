@@ -5,3 +5,11 @@ target("Heartbeat")
     add_files("Heartbeat.cpp")
     add_ldflags("-pthread")
     add_packages("spdlog")
+
+target("Replay")
+    set_kind("binary")
+    set_default(false)
+    add_deps("Protocon")
+    add_files("Replay.cpp")
+    add_ldflags("-pthread")
+    add_packages("spdlog")
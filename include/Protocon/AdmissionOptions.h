@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Protocon {
+
+// Inbound load shedding. Server requests past either limit are answered
+// with busyStatus right away, their handlers never run. 0 disables a limit.
+struct AdmissionOptions {
+    // Requests received but not yet handled by poll()
+    std::size_t maxQueuedRequests = 0;
+    // Judged by Request::time, which has a resolution of one second. Checked
+    // on arrival and again before the handler would run.
+    std::chrono::seconds maxRequestAge = std::chrono::seconds(0);
+    uint8_t busyStatus = 0xfe;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Protocon {
+
+// A host name or address and a port. For Unix domain sockets and shared
+// memory, host is the socket path or segment name and the port is ignored.
+struct Endpoint {
+    std::string host;
+    uint16_t port;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Protocon {
+
+// Liveness checks of the server connection, driven by poll(). The server has
+// to answer every heartbeat frame (0x03) with an ack (0x83) which echoes its
+// timestamp.
+struct HeartbeatOptions {
+    // How often a heartbeat is sent, 0 turns heartbeats and request
+    // timeouts off
+    std::chrono::milliseconds interval = std::chrono::seconds(1);
+    // The connection is shut down once nothing at all, acks included, has
+    // been received for this long
+    std::chrono::milliseconds deadTimeout = std::chrono::seconds(5);
+    // Requests without a response fail with timeoutStatus after the RTT
+    // based timeout, SRTT + 4 * RTTVAR, kept within these bounds. The upper
+    // one applies until the first ack has arrived.
+    std::chrono::milliseconds minRequestTimeout = std::chrono::seconds(1);
+    std::chrono::milliseconds maxRequestTimeout = std::chrono::seconds(30);
+    uint8_t timeoutStatus = 0xfd;
+};
+
+// Round trip time of the server connection, as measured by heartbeats
+struct RttStats {
+    std::chrono::microseconds srtt;
+    std::chrono::microseconds rttvar;
+    // SRTT + 4 * RTTVAR, before the request timeout bounds are applied
+    std::chrono::microseconds rto;
+    std::size_t samples;
+};
+
+}  // namespace Protocon
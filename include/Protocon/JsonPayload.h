@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Protocon {
+
+// Lazy view over a JSON object payload, backed by the simdjson On-Demand
+// parser. Nothing is parsed up front, each get() only scans as far as the
+// field it looks for. Payloads received by the gateway carry enough spare
+// capacity to be parsed in place, other strings are copied once.
+//
+// Reads share a parser per thread, so a JsonPayload is only valid until the
+// next one is created on the same thread.
+class JsonPayload {
+  public:
+    // Spare bytes the parser may read past the end of the payload
+    static constexpr std::size_t Padding = 64;
+
+    explicit JsonPayload(const std::string& data);
+    ~JsonPayload();
+
+    // False if the payload isn't an object, or the field is missing or of
+    // another type
+    bool get(const char* key, int64_t& value);
+    bool get(const char* key, uint64_t& value);
+    bool get(const char* key, double& value);
+    bool get(const char* key, bool& value);
+    bool get(const char* key, std::string& value);
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> mImpl;
+};
+
+}  // namespace Protocon
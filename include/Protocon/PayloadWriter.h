@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Protocon {
+
+class FramePool;
+
+// Outbound payload serialized straight into a pooled frame buffer, which
+// keeps room for the frame header in front. The Sender fills in the header
+// and writes the buffer as is, so large payloads are never copied again.
+// Get one from Gateway::createPayloadWriter() or a writer request handler.
+class PayloadWriter {
+  public:
+    PayloadWriter();
+    PayloadWriter(PayloadWriter&& writer);
+    PayloadWriter& operator=(PayloadWriter&& writer);
+    // Hands the buffer back to the pool unless it has been sent
+    ~PayloadWriter();
+
+    void append(const void* data, std::size_t n) { std::memcpy(extend(n), data, n); }
+    void append(const std::string& s) { append(s.data(), s.size()); }
+
+    // Grows the payload by n bytes and returns where to put them, valid
+    // until the next call
+    char* extend(std::size_t n) {
+        if (mFrame.empty()) mFrame.resize(HeaderRoom);
+        std::size_t size = mFrame.size();
+        mFrame.resize(size + n);
+        return mFrame.data() + size;
+    }
+
+    void reserve(std::size_t n) { mFrame.reserve(HeaderRoom + n); }
+
+    std::size_t size() const { return mFrame.empty() ? 0 : mFrame.size() - HeaderRoom; }
+    const char* data() const { return mFrame.empty() ? nullptr : mFrame.data() + HeaderRoom; }
+
+  private:
+    // Largest frame header, the one of a request
+    static constexpr std::size_t HeaderRoom = 35;
+
+    PayloadWriter(std::vector<char> frame, std::shared_ptr<FramePool> pool);
+
+    std::vector<char> mFrame;
+    std::shared_ptr<FramePool> mPool;
+
+    friend class FramePool;
+    friend class Sender;
+};
+
+}  // namespace Protocon
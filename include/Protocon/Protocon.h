@@ -1,18 +1,31 @@
 #pragma once
 
+#include <Protocon/AdmissionOptions.h>
 #include <Protocon/ClientToken.h>
+#include <Protocon/Endpoint.h>
+#include <Protocon/HeartbeatOptions.h>
+#include <Protocon/JsonPayload.h>
+#include <Protocon/PayloadWriter.h>
 #include <Protocon/Request.h>
 #include <Protocon/Response.h>
 #include <Protocon/SignInResponse.h>
 #include <Protocon/SignUpResponse.h>
+#include <Protocon/ThreadOptions.h>
+#include <Protocon/Trace.h>
+#include <Protocon/TransportProfile.h>
 
 #include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <ctime>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -21,7 +34,7 @@
 
 namespace Protocon {
 
-class Socket;
+class Transport;
 
 template <typename T>
 class ThreadSafeQueue;
@@ -29,14 +42,86 @@ class ThreadSafeQueue;
 template <typename K, typename T>
 class ThreadSafeUnorderedMap;
 
+class ResponseCache;
+
+class CaptureWriter;
+
+class Tracer;
+
+class FramePool;
+
+class SpillQueue;
+
+class Liveness;
+
+template <typename Dispatcher>
+class StaticGatewayBuilder;
+
+template <uint16_t Type, typename F, typename Next>
+class StaticDispatcher;
+
+class StaticDispatchEnd;
+
 using RequestHandler = std::function<Response(ClientToken, const Request&)>;
 
+// Serializes the response payload into the writer and returns the status
+using WriterRequestHandler = std::function<uint8_t(ClientToken, const Request&, PayloadWriter&)>;
+
 using ResponseHandler = std::function<void(const Response&)>;
 
+// Called for each client's response to a broadcast
+using BroadcastResponseHandler = std::function<void(ClientToken, const Response&)>;
+
+// Called once every client has responded to a broadcast
+using BroadcastCompletionHandler = std::function<void(const std::vector<std::pair<ClientToken, Response>>&)>;
+
 using SignUpResponseHandler = std::function<void(const SignUpResponse&)>;
 
 using SignInResponseHandler = std::function<void(const SignInResponse&)>;
 
+// Fills T from the fields a handler needs, false rejects the request
+template <typename T>
+using PayloadDecoder = std::function<bool(JsonPayload&, T&)>;
+
+template <typename T>
+using TypedRequestHandler = std::function<Response(ClientToken, const Request&, const T&)>;
+
+// Response status of a request whose payload failed to decode
+constexpr uint8_t InvalidPayloadStatus = 0xff;
+
+enum class TransportType {
+    // Blocking TCP on top of asio
+    Asio,
+    // Linux only, requires building with the io_uring option, falls back to
+    // Asio otherwise
+    IoUring,
+    // Unix domain socket to a server on the same host, run() takes the
+    // socket path as host and ignores the port. Not available on Windows.
+    Unix,
+    // Shared memory rings to a server on the same host, run() takes the
+    // segment name as host and ignores the port. Linux only.
+    SharedMemory,
+};
+
+// Successful responses of a cached request type are reused for requests with
+// the same payload, regardless of the client. Only enable it for idempotent
+// types.
+struct ResponseCacheOptions {
+    uint16_t type;
+    std::chrono::milliseconds ttl;
+    std::size_t capacity;
+};
+
+// Outbound requests go to segment files under `directory` while the gateway
+// is disconnected or more than `maxQueuedRequests` are waiting to be sent,
+// and are sent in order once it catches up. Spilled requests don't survive
+// a restart.
+struct SpillOptions {
+    std::string directory;
+    std::size_t maxQueuedRequests = 4096;
+    std::size_t segmentSize = 64 << 20;
+};
+
 class Gateway {
   public:
     Gateway(Gateway&& gateway);
@@ -60,17 +145,92 @@ class Gateway {
     }
 
     bool run(const char* host, uint16_t port);
+    // Over TCP all endpoints are tried in parallel and the first connection
+    // wins, other transports fail over in order. See TransportProfile for the
+    // connect timeout.
+    bool run(const std::vector<Endpoint>& endpoints);
     void stop();
 
     void poll();
     void send(ClientToken tk, Request&& r, ResponseHandler&& handler);
+    // Sends a payload built with a writer from createPayloadWriter()
+    void send(ClientToken tk, uint16_t type, PayloadWriter&& payload, ResponseHandler&& handler);
+
+    // Sends one request to many clients. The payload is stored once and
+    // shared by all their frames, which only differ in the header. Throws
+    // std::out_of_range for an unknown token and std::length_error for more
+    // clients than there are command IDs not waiting for a response, in
+    // which case nothing is sent.
+    void broadcast(const std::vector<ClientToken>& tks, Request&& r, BroadcastResponseHandler&& handler);
+    void broadcast(const std::vector<ClientToken>& tks, uint16_t type, PayloadWriter&& payload,
+                   BroadcastResponseHandler&& handler);
+    // Like broadcast(), with the responses delivered all at once in the
+    // order of tks
+    void broadcastCollect(const std::vector<ClientToken>& tks, Request&& r, BroadcastCompletionHandler&& handler);
+
+    PayloadWriter createPayloadWriter();
+
+    // Server requests answered as busy by admission control
+    std::size_t shedRequests() const;
+
+    // Outbound requests waiting on disk, see GatewayBuilder::withSpill()
+    std::size_t spilledRequests() const;
+
+    // Zero until GatewayBuilder::withHeartbeat() has measured something
+    RttStats rttStats() const;
+
+    // Drop cached responses of a request type, or only the one for `data`
+    void invalidateResponseCache(uint16_t type);
+    void invalidateResponseCache(uint16_t type, const std::string& data);
+
+    // Only available with GatewayBuilder::withTracing(), may be called while
+    // the gateway is running
+    bool writeTrace(const std::string& path) const;
+    std::vector<TraceHistogram> traceHistograms() const;
+
+  protected:
+    using StaticDispatch = void (*)(void* dispatcher, ClientToken tk, const Request& r, Response& response);
+    using StaticHandles = bool (*)(uint16_t type);
+
+    // Request types for which `handles` is true go to `dispatch` instead of
+    // the handler maps, see StaticGateway
+    void setStaticDispatch(std::shared_ptr<void> dispatcher, StaticDispatch dispatch, StaticHandles handles);
 
   private:
     Gateway(uint16_t apiVersion, uint64_t gatewayId,
             SignUpResponseHandler SignUpResponseHandler, SignInResponseHandler SignInResponseHandler,
-            std::vector<std::pair<uint16_t, RequestHandler>> requestHandlers);
-
-    uint16_t nextCmdId() { return mCmdIdCounter++; }
+            std::vector<std::pair<uint16_t, RequestHandler>> requestHandlers,
+            std::vector<std::pair<uint16_t, WriterRequestHandler>> writerRequestHandlers,
+            std::vector<ResponseCacheOptions> responseCaches,
+            std::string capturePath,
+            TransportType transportType,
+            TransportProfile transportProfile,
+            std::size_t traceCapacity,
+            AdmissionOptions admission,
+            SpillOptions spill,
+            ThreadOptions receiverThread,
+            ThreadOptions senderThread,
+            HeartbeatOptions heartbeat);
+
+    void pollSignUpResponses();
+    void enqueueRequest(struct RawRequest&& r);
+    void expectResponse(uint16_t cmdId, ResponseHandler&& handler);
+    void checkLiveness();
+    std::chrono::steady_clock::duration requestTimeout() const;
+    template <typename F>
+    void enqueueBroadcast(const std::vector<ClientToken>& tks, uint16_t type, PayloadWriter&& payload, F handlerOf);
+    Response handleRequest(ClientToken tk, const Request& r, const RequestHandler& handler);
+    // Whether poll() dispatches requests of this type
+    bool handles(uint16_t type) const;
+
+    static constexpr std::size_t CmdIdSpace = 1 << 16;
+
+    // Skips IDs still waiting for a response unless all of them are
+    uint16_t nextCmdId() {
+        while (mRequestResponseHandlerMap.count(mCmdIdCounter) && mRequestResponseHandlerMap.size() < CmdIdSpace)
+            mCmdIdCounter++;
+        return mCmdIdCounter++;
+    }
 
     void sendSignUpRequest();
     void sendSignInRequest(uint64_t clientId);
@@ -80,13 +240,42 @@ class Gateway {
     SignUpResponseHandler mSignUpResponseHandler;
     SignInResponseHandler mSignInResponseHandler;
     std::unordered_map<uint16_t, RequestHandler> mRequestHandlerMap;
+    std::unordered_map<uint16_t, WriterRequestHandler> mWriterRequestHandlerMap;
+    std::unordered_map<uint16_t, std::unique_ptr<ResponseCache>> mResponseCacheMap;
 
     uint64_t mTokenCounter = 0;
     std::vector<ClientToken> mAnonymousTokens;
     std::unordered_map<ClientToken, uint64_t> mTokenClientIdMap;
     std::unordered_map<uint64_t, ClientToken> mClientIdTokenMap;
 
-    std::unique_ptr<Socket> mSocket;
+    std::string mCapturePath;
+    std::unique_ptr<CaptureWriter> mCapture;
+
+    std::unique_ptr<Tracer> mTracer;
+
+    std::shared_ptr<FramePool> mFramePool;
+
+    AdmissionOptions mAdmission;
+    // Shed by poll(), the Receiver counts its own
+    std::size_t mShedRequests = 0;
+
+    std::unique_ptr<SpillQueue> mSpill;
+    std::size_t mSpillMaxQueuedRequests;
+
+    HeartbeatOptions mHeartbeat;
+    // Only set up with heartbeats
+    std::unique_ptr<Liveness> mLiveness;
+    std::chrono::steady_clock::time_point mLastHeartbeat;
+    // Requests waiting for a response in the order they were sent, entries
+    // are stale unless mPendingSince still has the same time for the cmdId
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint16_t>> mPendingRequests;
+    std::unordered_map<uint16_t, std::chrono::steady_clock::time_point> mPendingSince;
+
+    TransportType mTransportType;
+    TransportProfile mTransportProfile;
+    ThreadOptions mReceiverThread;
+    ThreadOptions mSenderThread;
+    std::unique_ptr<Transport> mTransport;
 
     std::unique_ptr<class Receiver> mReceiver;
     std::unique_ptr<class Sender> mSender;
@@ -106,6 +295,11 @@ class Gateway {
     std::unique_ptr<ThreadSafeQueue<struct RawResponse>> mResponseTx;
     std::unique_ptr<ThreadSafeQueue<struct RawSignUpRequest>> mSignUpRequestTx;
     std::unique_ptr<ThreadSafeQueue<struct RawSignInRequest>> mSignInRequestTx;
+    std::unique_ptr<ThreadSafeQueue<struct RawHeartbeat>> mHeartbeatTx;
+
+    std::shared_ptr<void> mStaticDispatcher;
+    StaticDispatch mStaticDispatch = nullptr;
+    StaticHandles mStaticHandles = nullptr;
 
     friend class GatewayBuilder;
 };
@@ -129,12 +323,104 @@ class GatewayBuilder {
         mRequestHandlers.emplace_back(std::make_pair(type, std::move(handler)));
         return *this;
     }
+    // The payload is decoded by `decoder` before `handler` runs, a request it
+    // rejects is answered with InvalidPayloadStatus
+    template <typename T>
+    GatewayBuilder& withTypedRequestHandler(uint16_t type, PayloadDecoder<T> decoder, TypedRequestHandler<T> handler) {
+        return withRequestHandler(type, [decoder, handler](ClientToken tk, const Request& r) {
+            JsonPayload json(r.data);
+            T payload{};
+            if (!decoder(json, payload))
+                return Response{static_cast<uint64_t>(std::time(nullptr)), InvalidPayloadStatus, ""};
+
+            return handler(tk, r, payload);
+        });
+    }
+    // Handler of a request type fixed at compile time, called without any
+    // lookup or type erasure. Turns the builder into a StaticGatewayBuilder,
+    // so configure everything else first. Defined in Protocon/StaticGateway.h.
+    template <uint16_t Type, typename F>
+    StaticGatewayBuilder<StaticDispatcher<Type, std::decay_t<F>, StaticDispatchEnd>> withHandler(F&& handler);
+    // The response payload goes straight into a pooled frame buffer, large
+    // payloads skip every copy on the way to the transport. Not cached.
+    GatewayBuilder& withWriterRequestHandler(uint16_t type, WriterRequestHandler handler) {
+        mWriterRequestHandlers.emplace_back(std::make_pair(type, std::move(handler)));
+        return *this;
+    }
+    // Reuse successful (status 0) responses of a request type for `ttl`. The
+    // cache is keyed on type and payload only and shared by all clients, so
+    // handlers whose response depends on the ClientToken must not use it.
+    GatewayBuilder& withResponseCache(uint16_t type, std::chrono::milliseconds ttl, std::size_t capacity) {
+        mResponseCaches.emplace_back(ResponseCacheOptions{type, ttl, capacity});
+        return *this;
+    }
+    // Append every raw frame sent or received to a capture file, which can
+    // be fed back through a gateway offline with Protocon::Replay
+    GatewayBuilder& withCapture(std::string path) {
+        mCapturePath = std::move(path);
+        return *this;
+    }
+    // Record nanosecond timestamps of every request as it passes through
+    // send(), the Sender, the transport, the Receiver and poll(). Each thread
+    // keeps up to `capacity` events, later ones are dropped.
+    GatewayBuilder& withTracing(std::size_t capacity = 1 << 18) {
+        mTraceCapacity = capacity;
+        return *this;
+    }
+    // Answer server requests with a busy status instead of queueing them
+    // once the gateway falls behind
+    GatewayBuilder& withAdmissionControl(AdmissionOptions options) {
+        mAdmission = options;
+        return *this;
+    }
+    // Keep outbound requests on disk instead of in memory during outages
+    // and bursts, see SpillOptions
+    GatewayBuilder& withSpill(std::string directory, std::size_t maxQueuedRequests = 4096,
+                              std::size_t segmentSize = 64 << 20) {
+        mSpill = SpillOptions{std::move(directory), maxQueuedRequests, segmentSize};
+        return *this;
+    }
+    // Pin, name and optionally busy-poll the thread reading from the server
+    GatewayBuilder& withReceiverThread(ThreadOptions options) {
+        mReceiverThread = std::move(options);
+        return *this;
+    }
+    // Same for the thread writing to the server
+    GatewayBuilder& withSenderThread(ThreadOptions options) {
+        mSenderThread = std::move(options);
+        return *this;
+    }
+    // Detect a dead server connection within options.deadTimeout and fail
+    // requests which go unanswered for longer than the measured RTT allows
+    GatewayBuilder& withHeartbeat(HeartbeatOptions options = HeartbeatOptions()) {
+        mHeartbeat = options;
+        return *this;
+    }
+    GatewayBuilder& withTransport(TransportType type) {
+        mTransportType = type;
+        return *this;
+    }
+    GatewayBuilder& withTransportProfile(TransportProfile profile) {
+        mTransportProfile = profile;
+        return *this;
+    }
     Gateway build() {
         return Gateway(
             mApiVersion,
             mGatewayId,
             mSignUpResponseHandler, mSignInResponseHandler,
-            std::move(mRequestHandlers));
+            std::move(mRequestHandlers),
+            std::move(mWriterRequestHandlers),
+            std::move(mResponseCaches),
+            std::move(mCapturePath),
+            mTransportType,
+            mTransportProfile,
+            mTraceCapacity,
+            mAdmission,
+            std::move(mSpill),
+            mReceiverThread,
+            mSenderThread,
+            mHeartbeat);
     }
 
   private:
@@ -145,6 +431,18 @@ class GatewayBuilder {
     SignUpResponseHandler mSignUpResponseHandler = [](auto r) {};
     SignInResponseHandler mSignInResponseHandler = [](auto r) {};
     std::vector<std::pair<uint16_t, RequestHandler>> mRequestHandlers;
+    std::vector<std::pair<uint16_t, WriterRequestHandler>> mWriterRequestHandlers;
+    std::vector<ResponseCacheOptions> mResponseCaches;
+    std::string mCapturePath;
+    TransportType mTransportType = TransportType::Asio;
+    TransportProfile mTransportProfile;
+    std::size_t mTraceCapacity = 0;
+    AdmissionOptions mAdmission;
+    SpillOptions mSpill;
+    ThreadOptions mReceiverThread;
+    ThreadOptions mSenderThread;
+    // Off unless withHeartbeat() is called
+    HeartbeatOptions mHeartbeat{std::chrono::milliseconds(0)};
 };
 
 }  // namespace Protocon
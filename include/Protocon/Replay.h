@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Protocon {
+
+// Plays the inbound side of a capture file back as a fake server on a
+// loopback port, a Unix domain socket or a shared memory segment. A gateway
+// connected to it goes through the usual frame parsing and poll() dispatch,
+// so decoding and handlers can be benchmarked against recorded production
+// traffic.
+class Replay {
+  public:
+    Replay(std::string path);
+    ~Replay();
+
+    // Must succeed before the gateway tries to connect
+    bool listen(uint16_t port);
+    // For gateways built with TransportType::Unix
+    bool listenUnix(const std::string& path);
+    // For gateways built with TransportType::SharedMemory, Linux only
+    bool listenSharedMemory(const std::string& name);
+
+    // Accepts one gateway, writes every inbound frame of the capture, either
+    // at the recorded pace or as fast as possible, then waits for the gateway
+    // to close. Returns the number of captured frames written.
+    //
+    // With batch set and realtime not, consecutive requests and responses go
+    // out packed into batch frames.
+    std::size_t serve(bool realtime, bool batch = false);
+
+    // Stops a serve() that is still waiting for a gateway, it then returns
+    // 0. Meant to be called from another thread when the gateway gave up.
+    void close();
+
+  private:
+    std::string mPath;
+
+    std::unique_ptr<class Listener> mListener;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Protocon/Protocon.h>
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace Protocon {
+
+class StaticDispatchEnd {
+  public:
+    static constexpr bool Handles(uint16_t type) { return false; }
+    void dispatch(ClientToken tk, const Request& r, Response& response) {}
+};
+
+// Compile-time list of request handlers, each link compares the type and
+// calls its handler directly, so the compiler can inline the whole chain
+template <uint16_t Type, typename F, typename Next>
+class StaticDispatcher {
+    static_assert(!Next::Handles(Type), "Request type has more than one handler");
+
+  public:
+    StaticDispatcher(F handler, Next next) : mHandler(std::move(handler)), mNext(std::move(next)) {}
+
+    static constexpr bool Handles(uint16_t type) { return type == Type || Next::Handles(type); }
+
+    void dispatch(ClientToken tk, const Request& r, Response& response) {
+        if (r.type == Type)
+            response = mHandler(tk, r);
+        else
+            mNext.dispatch(tk, r, response);
+    }
+
+  private:
+    F mHandler;
+    Next mNext;
+};
+
+// A Gateway whose request handlers are known at compile time. Requests of
+// their types skip the handler maps and the response cache, everything
+// else behaves like Gateway, including handlers registered at runtime.
+template <typename Dispatcher>
+class StaticGateway : public Gateway {
+  public:
+    StaticGateway(Gateway&& gateway, Dispatcher dispatcher) : Gateway(std::move(gateway)) {
+        setStaticDispatch(std::make_shared<Dispatcher>(std::move(dispatcher)), &Dispatch, &Dispatcher::Handles);
+    }
+
+  private:
+    static void Dispatch(void* dispatcher, ClientToken tk, const Request& r, Response& response) {
+        static_cast<Dispatcher*>(dispatcher)->dispatch(tk, r, response);
+    }
+};
+
+template <typename Dispatcher>
+class StaticGatewayBuilder {
+  public:
+    StaticGatewayBuilder(GatewayBuilder&& builder, Dispatcher dispatcher)
+        : mBuilder(std::move(builder)), mDispatcher(std::move(dispatcher)) {}
+
+    template <uint16_t Type, typename F>
+    StaticGatewayBuilder<StaticDispatcher<Type, std::decay_t<F>, Dispatcher>> withHandler(F&& handler) {
+        return StaticGatewayBuilder<StaticDispatcher<Type, std::decay_t<F>, Dispatcher>>(
+            std::move(mBuilder),
+            StaticDispatcher<Type, std::decay_t<F>, Dispatcher>(std::forward<F>(handler), std::move(mDispatcher)));
+    }
+
+    StaticGateway<Dispatcher> build() {
+        return StaticGateway<Dispatcher>(mBuilder.build(), std::move(mDispatcher));
+    }
+
+  private:
+    GatewayBuilder mBuilder;
+    Dispatcher mDispatcher;
+};
+
+template <uint16_t Type, typename F>
+StaticGatewayBuilder<StaticDispatcher<Type, std::decay_t<F>, StaticDispatchEnd>> GatewayBuilder::withHandler(F&& handler) {
+    return StaticGatewayBuilder<StaticDispatcher<Type, std::decay_t<F>, StaticDispatchEnd>>(
+        std::move(*this),
+        StaticDispatcher<Type, std::decay_t<F>, StaticDispatchEnd>(std::forward<F>(handler), StaticDispatchEnd()));
+}
+
+}  // namespace Protocon
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace Protocon {
+
+// Placement and idle behaviour of a gateway I/O thread
+struct ThreadOptions {
+    // Core to pin the thread to, -1 leaves it to the scheduler
+    int cpu = -1;
+    // Restricts the thread to the cores of a NUMA node, -1 for any. Ignored
+    // when cpu is set. Linux only, like cpu.
+    int numaNode = -1;
+    // Shown by top and perf, truncated to 15 characters
+    std::string name;
+    // Spin with adaptive backoff instead of blocking or sleeping while idle.
+    // Trades a core per thread for lower and steadier wakeup latency.
+    bool busyPoll = false;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Protocon {
+
+// Latency distribution of one hop of a traced request, e.g.
+// "request/enqueue->dequeue" or "server_request/parse->dispatch". The
+// "<flow>/total" hop spans from the first to the last traced stage.
+struct TraceHistogram {
+    std::string hop;
+    std::size_t count;
+
+    // Nanoseconds
+    uint64_t min;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+
+    // buckets[i] counts latencies in [2^(i-1), 2^i) ns, buckets[0] the zeros
+    std::vector<std::size_t> buckets;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace Protocon {
+
+// Socket options and Sender batching used by a gateway connection. Start
+// from one of the presets and override single fields where needed.
+struct TransportProfile {
+    // TCP_NODELAY
+    bool noDelay = false;
+    // Hold back partial batches with MSG_MORE until the Sender runs out of
+    // queued frames, where the platform has MSG_MORE. TCP_CORK is never set.
+    bool cork = false;
+    // SO_BUSY_POLL in microseconds, Linux only, 0 disables it
+    int busyPollUs = 0;
+    // SO_SNDBUF and SO_RCVBUF, 0 keeps the OS default
+    int sendBufferSize = 0;
+    int receiveBufferSize = 0;
+
+    // TCP connects give up after this long, across all endpoints and
+    // including name resolution
+    std::chrono::milliseconds connectTimeout = std::chrono::seconds(10);
+    // Parallel connection attempts are started this far apart
+    std::chrono::milliseconds connectAttemptDelay = std::chrono::milliseconds(250);
+
+    // A batch is flushed once it grows past this size
+    std::size_t maxBatchBytes = 64 << 10;
+    // How long a non-full batch waits for more frames before it's flushed
+    std::chrono::microseconds batchDelay = std::chrono::microseconds(0);
+    // How long the Sender sleeps when there is nothing to send
+    std::chrono::microseconds idleInterval = std::chrono::milliseconds(400);
+    // Pack requests and responses queued together into batch frames (0x04).
+    // Only for servers known to accept them, none of the presets turn it on.
+    bool batchFrames = false;
+
+    static TransportProfile Default() { return TransportProfile(); }
+
+    static TransportProfile LowLatency() {
+        TransportProfile p;
+        p.noDelay = true;
+        p.busyPollUs = 50;
+        p.maxBatchBytes = 4 << 10;
+        p.idleInterval = std::chrono::microseconds(100);
+        return p;
+    }
+
+    static TransportProfile Throughput() {
+        TransportProfile p;
+        p.cork = true;
+        p.sendBufferSize = 4 << 20;
+        p.receiveBufferSize = 4 << 20;
+        p.maxBatchBytes = 256 << 10;
+        p.batchDelay = std::chrono::microseconds(200);
+        p.idleInterval = std::chrono::milliseconds(10);
+        return p;
+    }
+};
+
+}  // namespace Protocon
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace Protocon {
+
+// Idle wait of a busy-polling loop. Spins first, then yields the core, then
+// sleeps for doubling intervals up to maxSleep. reset() once there is work.
+class Backoff {
+  public:
+    explicit Backoff(std::chrono::microseconds maxSleep) : mMaxSleep(maxSleep) {}
+
+    // Spins or yields once, false once both are exhausted
+    bool spin() {
+        if (mCount < SpinLimit) {
+            relax();
+        } else if (mCount < SpinLimit + YieldLimit) {
+            std::this_thread::yield();
+        } else {
+            return false;
+        }
+
+        mCount++;
+        return true;
+    }
+
+    void idle() {
+        if (spin()) return;
+
+        std::this_thread::sleep_for(mSleep);
+        mSleep = std::min(mSleep * 2, mMaxSleep);
+    }
+
+    void reset() {
+        mCount = 0;
+        mSleep = std::chrono::microseconds(1);
+    }
+
+  private:
+    static constexpr uint32_t SpinLimit = 1 << 14;
+    static constexpr uint32_t YieldLimit = 1 << 10;
+
+    static void relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    std::chrono::microseconds mMaxSleep;
+    uint32_t mCount = 0;
+    std::chrono::microseconds mSleep = std::chrono::microseconds(1);
+};
+
+}  // namespace Protocon
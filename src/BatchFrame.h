@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Util.h"
+
+namespace Protocon {
+
+// Several requests and responses in one frame, sent when
+// TransportProfile::batchFrames is on. Integers are big endian like
+// everywhere else, lengths and client IDs are LEB128 varints:
+//
+//   uint8 0x04, uint16 count, uint64 gatewayId, uint16 apiVersion,
+//   uint64 time, then count commands of uint8 flag, uint16 cmdId and
+//     0x00 request:  varint clientId, uint16 type, varint length, payload
+//     0x80 response: uint8 status, varint length, payload
+//
+// gatewayId, apiVersion and time are shared by every command, gatewayId
+// and apiVersion are 0 when there are no requests.
+class BatchFrame {
+  public:
+    static constexpr uint8_t Flag = 0x04;
+    static constexpr std::size_t HeaderSize = sizeof(uint8_t) + sizeof(uint16_t) + 2 * sizeof(uint64_t) + sizeof(uint16_t);
+    static constexpr std::size_t MaxCommands = 0xffff;
+    // Longest varint of a uint64_t
+    static constexpr std::size_t MaxVarintSize = 10;
+
+    // Leaves room for the header, returns where the frame begins
+    static std::size_t Begin(std::vector<char>& buf) {
+        std::size_t begin = buf.size();
+        buf.resize(begin + HeaderSize);
+        return begin;
+    }
+
+    static void End(std::vector<char>& buf, std::size_t begin, uint16_t count,
+                    uint64_t gatewayId, uint16_t apiVersion, uint64_t time) {
+        char* p = buf.data() + begin;
+        *p++ = static_cast<char>(Flag);
+        p = put(p, Util::BigEndian(count));
+        p = put(p, Util::BigEndian(gatewayId));
+        p = put(p, Util::BigEndian(apiVersion));
+        put(p, Util::BigEndian(time));
+    }
+
+    static void PutRequest(std::vector<char>& buf, uint16_t cmdId, uint64_t clientId, uint16_t type,
+                           const char* data, std::size_t length) {
+        buf.push_back(0x00);
+        append(buf, Util::BigEndian(cmdId));
+        PutVarint(buf, clientId);
+        append(buf, Util::BigEndian(type));
+        PutVarint(buf, length);
+        buf.insert(buf.end(), data, data + length);
+    }
+
+    static void PutResponse(std::vector<char>& buf, uint16_t cmdId, uint8_t status,
+                            const char* data, std::size_t length) {
+        buf.push_back(static_cast<char>(0x80));
+        append(buf, Util::BigEndian(cmdId));
+        buf.push_back(static_cast<char>(status));
+        PutVarint(buf, length);
+        buf.insert(buf.end(), data, data + length);
+    }
+
+    static void PutVarint(std::vector<char>& buf, uint64_t v) {
+        while (v >= 0x80) {
+            buf.push_back(static_cast<char>(v | 0x80));
+            v >>= 7;
+        }
+        buf.push_back(static_cast<char>(v));
+    }
+
+    // Upper bound of what PutRequest() or PutResponse() appends
+    static std::size_t CommandSize(std::size_t length) {
+        return sizeof(uint8_t) + 2 * sizeof(uint16_t) + 2 * MaxVarintSize + length;
+    }
+
+  private:
+    template <typename T>
+    static char* put(char* p, T v) {
+        std::memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+
+    template <typename T>
+    static void append(std::vector<char>& buf, T v) {
+        auto p = reinterpret_cast<const char*>(&v);
+        buf.insert(buf.end(), p, p + sizeof(v));
+    }
+
+    BatchFrame() {}
+};
+
+}  // namespace Protocon
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "Util.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Protocon {
+
+// Capture file layout, all integers are big endian:
+//   magic "PRTCAP01"
+//   records: uint64 time (ns, monotonic), uint8 direction, uint32 length, raw frame bytes
+class Capture {
+  public:
+    enum Direction : uint8_t {
+        Inbound = 0x00,
+        Outbound = 0x01,
+    };
+
+    static const char* Magic() { return "PRTCAP01"; }
+    static constexpr std::size_t MagicSize = 8;
+    static constexpr std::size_t RecordHeaderSize = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+  private:
+    Capture() {}
+};
+
+// Append-only writer backed by a memory-mapped file which grows in chunks.
+// Shared by the Receiver and the Sender, appends are serialized by a mutex.
+class CaptureWriter {
+  public:
+    ~CaptureWriter() { close(); }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        spdlog::warn("Traffic capture is not supported on this platform");
+        return false;
+#else
+        mFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (mFd < 0) {
+            spdlog::warn("Failed to open capture file {}, details: {}", path, std::strerror(errno));
+            return false;
+        }
+
+        if (!reserve(Capture::MagicSize)) {
+            close();
+            return false;
+        }
+        std::memcpy(mMap, Capture::Magic(), Capture::MagicSize);
+        mSize = Capture::MagicSize;
+
+        return true;
+#endif
+    }
+
+    void append(Capture::Direction direction, const void* buf, std::size_t n) {
+        uint64_t time = Util::BigEndian(Capture::Now());
+        uint32_t length = Util::BigEndian(static_cast<uint32_t>(n));
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (!mMap || !reserve(mSize + Capture::RecordHeaderSize + n)) return;
+
+        char* p = mMap + mSize;
+        std::memcpy(p, &time, sizeof(time));
+        p += sizeof(time);
+        std::memcpy(p, &direction, sizeof(direction));
+        p += sizeof(direction);
+        std::memcpy(p, &length, sizeof(length));
+        p += sizeof(length);
+        std::memcpy(p, buf, n);
+
+        mSize += Capture::RecordHeaderSize + n;
+    }
+
+    void close() {
+#ifndef _WIN32
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (mMap) {
+            ::munmap(mMap, mCapacity);
+            mMap = nullptr;
+        }
+        if (mFd >= 0) {
+            // Drop the unused tail of the last chunk
+            if (::ftruncate(mFd, mSize))
+                spdlog::warn("Failed to truncate capture file, details: {}", std::strerror(errno));
+            ::close(mFd);
+            mFd = -1;
+        }
+        mCapacity = 0;
+        mSize = 0;
+#endif
+    }
+
+  private:
+    static constexpr std::size_t ChunkSize = 16 << 20;
+
+    bool reserve(std::size_t n) {
+#ifdef _WIN32
+        return false;
+#else
+        if (n <= mCapacity) return true;
+
+        std::size_t capacity = (n + ChunkSize - 1) / ChunkSize * ChunkSize;
+        if (::ftruncate(mFd, capacity)) {
+            spdlog::warn("Failed to grow capture file, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        if (mMap) ::munmap(mMap, mCapacity);
+        void* map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+        if (map == MAP_FAILED) {
+            spdlog::warn("Failed to map capture file, details: {}", std::strerror(errno));
+            mMap = nullptr;
+            mCapacity = 0;
+            return false;
+        }
+
+        mMap = static_cast<char*>(map);
+        mCapacity = capacity;
+        return true;
+#endif
+    }
+
+    std::mutex mMtx;
+    int mFd = -1;
+    char* mMap = nullptr;
+    std::size_t mCapacity = 0;
+    std::size_t mSize = 0;
+};
+
+// Sequential reader over a memory-mapped capture file
+class CaptureReader {
+  public:
+    struct Record {
+        uint64_t time;
+        Capture::Direction direction;
+        const char* data;
+        uint32_t length;
+    };
+
+    ~CaptureReader() {
+#ifndef _WIN32
+        if (mMap) ::munmap(const_cast<char*>(mMap), mSize);
+#endif
+    }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        spdlog::warn("Traffic capture is not supported on this platform");
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            spdlog::warn("Failed to open capture file {}, details: {}", path, std::strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) || static_cast<std::size_t>(st.st_size) < Capture::MagicSize) {
+            spdlog::warn("Invalid capture file {}", path);
+            ::close(fd);
+            return false;
+        }
+
+        void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            spdlog::warn("Failed to map capture file, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        if (std::memcmp(map, Capture::Magic(), Capture::MagicSize)) {
+            spdlog::warn("Invalid capture file {}", path);
+            ::munmap(map, st.st_size);
+            return false;
+        }
+
+        mMap = static_cast<const char*>(map);
+        mSize = st.st_size;
+        mOffset = Capture::MagicSize;
+
+        return true;
+#endif
+    }
+
+    bool next(Record& r) {
+        if (!mMap || mOffset + Capture::RecordHeaderSize > mSize) return false;
+
+        const char* p = mMap + mOffset;
+        std::memcpy(&r.time, p, sizeof(r.time));
+        r.time = Util::BigEndian(r.time);
+        p += sizeof(r.time);
+        std::memcpy(&r.direction, p, sizeof(r.direction));
+        p += sizeof(r.direction);
+        std::memcpy(&r.length, p, sizeof(r.length));
+        r.length = Util::BigEndian(r.length);
+        p += sizeof(r.length);
+
+        // Truncated record, e.g. the process was killed while writing
+        if (mOffset + Capture::RecordHeaderSize + r.length > mSize) return false;
+
+        r.data = p;
+        mOffset += Capture::RecordHeaderSize + r.length;
+        return true;
+    }
+
+  private:
+    const char* mMap = nullptr;
+    std::size_t mSize = 0;
+    std::size_t mOffset = 0;
+};
+
+}  // namespace Protocon
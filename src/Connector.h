@@ -0,0 +1,207 @@
+#pragma once
+
+#include <Protocon/Endpoint.h>
+#include <spdlog/spdlog.h>
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Protocon {
+
+// Happy Eyeballs (RFC 8305) style TCP connect. All endpoints are resolved in
+// parallel and their addresses are tried alternating between IPv6 and IPv4.
+// A new attempt starts every `attemptDelay`, or right away when the last one
+// fails, without giving up on those still pending. The first connection to
+// complete wins and the others are closed. Gives up after `timeout`.
+//
+// getaddrinfo can't be cancelled, so each endpoint is resolved on a detached
+// thread of its own. Lookups still running at the deadline are abandoned and
+// their results dropped, which keeps a slow DNS server within `timeout`.
+class Connector {
+  public:
+    // Blocking name lookup, called on the resolving threads
+    using Resolve = std::function<asio::ip::tcp::resolver::results_type(
+        const std::string& host, const std::string& service, asio::error_code& ec)>;
+
+    Connector(asio::io_context& context, std::chrono::milliseconds attemptDelay, std::chrono::milliseconds timeout,
+              Resolve resolve = SystemResolve)
+        : mContext(context),
+          mResolve(std::move(resolve)),
+          mResolveState(std::make_shared<ResolveState>()),
+          mAttemptTimer(context),
+          mDeadline(context),
+          mAttemptDelay(attemptDelay),
+          mTimeout(timeout) {
+        mResolveState->context = &mContext;
+    }
+
+    ~Connector() { abandonResolves(); }
+
+    static asio::ip::tcp::resolver::results_type SystemResolve(const std::string& host, const std::string& service,
+                                                              asio::error_code& ec) {
+        asio::io_context context;
+        asio::ip::tcp::resolver resolver(context);
+        return resolver.resolve(host, service, ec);
+    }
+
+    // Runs the io_context until done, `socket` has to belong to it
+    bool connect(const std::vector<Endpoint>& endpoints, asio::ip::tcp::socket& socket) {
+        if (endpoints.empty()) {
+            spdlog::warn("Failed to connect to server, details: no endpoints");
+            return false;
+        }
+
+        mPendingResolves = endpoints.size();
+        for (const auto& e : endpoints) {
+            // Results are handed to the io_context unless connect() is done
+            std::thread([this, e, resolve = mResolve, state = mResolveState] {
+                asio::error_code ec;
+                auto results = resolve(e.host, std::to_string(e.port), ec);
+
+                std::lock_guard<std::mutex> lock(state->mtx);
+                if (!state->context) return;
+                asio::post(*state->context, [this, e, ec, results] { onResolved(e, ec, results); });
+            }).detach();
+        }
+
+        mDeadline.expires_after(mTimeout);
+        mDeadline.async_wait([this](const asio::error_code& ec) {
+            if (ec || mDone) return;
+            mLastError = "timed out";
+            finish();
+        });
+
+        mContext.restart();
+        mContext.run();
+
+        if (!mWinner) {
+            spdlog::warn("Failed to connect to server, details: {}", mLastError);
+            return false;
+        }
+
+        socket = std::move(*mWinner);
+        return true;
+    }
+
+  private:
+    // Shared with the resolving threads, which may outlive the Connector
+    struct ResolveState {
+        std::mutex mtx;
+        asio::io_context* context = nullptr;
+    };
+
+    void onResolved(const Endpoint& e, const asio::error_code& ec, const asio::ip::tcp::resolver::results_type& results) {
+        mPendingResolves--;
+        if (mDone) return;
+
+        if (ec) {
+            mLastError = e.host + ": " + ec.message();
+        } else {
+            for (const auto& r : results)
+                (r.endpoint().address().is_v6() ? mV6 : mV4).push_back(r.endpoint());
+        }
+
+        if (!mInFlight || mAttemptDue) startAttempt();
+    }
+
+    // Lookups finishing from here on are dropped
+    void abandonResolves() {
+        std::lock_guard<std::mutex> lock(mResolveState->mtx);
+        mResolveState->context = nullptr;
+    }
+
+    // Next address, alternating address families, IPv6 first
+    bool next(asio::ip::tcp::endpoint& endpoint) {
+        auto* first = mLastV6 ? &mV4 : &mV6;
+        auto* second = mLastV6 ? &mV6 : &mV4;
+        if (first->empty()) std::swap(first, second);
+        if (first->empty()) return false;
+
+        endpoint = first->front();
+        first->pop_front();
+        mLastV6 = endpoint.address().is_v6();
+        return true;
+    }
+
+    void startAttempt() {
+        asio::ip::tcp::endpoint endpoint;
+        if (!next(endpoint)) {
+            // Nothing to try yet, the next resolved address goes right away
+            mAttemptDue = true;
+            if (!mInFlight && !mPendingResolves) finish();
+            return;
+        }
+        mAttemptDue = false;
+
+        mAttempts.push_back(std::make_unique<asio::ip::tcp::socket>(mContext));
+        asio::ip::tcp::socket* socket = mAttempts.back().get();
+        mInFlight++;
+
+        socket->async_connect(endpoint, [this, socket, endpoint](const asio::error_code& ec) {
+            mInFlight--;
+            if (mDone) return;
+
+            if (!ec) {
+                for (auto& s : mAttempts)
+                    if (s.get() == socket) mWinner = std::move(s);
+                finish();
+                return;
+            }
+
+            mLastError = endpoint.address().to_string() + ": " + ec.message();
+            startAttempt();
+        });
+
+        mAttemptTimer.expires_after(mAttemptDelay);
+        mAttemptTimer.async_wait([this](const asio::error_code& ec) {
+            if (ec || mDone) return;
+            startAttempt();
+        });
+    }
+
+    // Cancels everything still pending, which lets run() return
+    void finish() {
+        mDone = true;
+        abandonResolves();
+        mAttemptTimer.cancel();
+        mDeadline.cancel();
+
+        asio::error_code ec;
+        for (auto& s : mAttempts)
+            if (s) s->close(ec);
+    }
+
+    asio::io_context& mContext;
+    Resolve mResolve;
+    std::shared_ptr<ResolveState> mResolveState;
+    asio::steady_timer mAttemptTimer;
+    asio::steady_timer mDeadline;
+    std::chrono::milliseconds mAttemptDelay;
+    std::chrono::milliseconds mTimeout;
+
+    std::deque<asio::ip::tcp::endpoint> mV6;
+    std::deque<asio::ip::tcp::endpoint> mV4;
+    bool mLastV6 = false;
+
+    std::size_t mPendingResolves = 0;
+    std::size_t mInFlight = 0;
+    bool mAttemptDue = false;
+    bool mDone = false;
+
+    std::vector<std::unique_ptr<asio::ip::tcp::socket>> mAttempts;
+    std::unique_ptr<asio::ip::tcp::socket> mWinner;
+    std::string mLastError;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+namespace Protocon {
+
+// Per-key FIFO lanes served by deficit round-robin, where the cost of an
+// item is given by the caller (bytes on the wire for the Sender). Every
+// active lane gets `quantum` credit per round, so a key with a large
+// backlog cannot starve keys that only have a few small items queued.
+// Not thread-safe, it's meant to be owned by a single consumer thread.
+template <typename K, typename T>
+class DeficitRoundRobin {
+  public:
+    explicit DeficitRoundRobin(std::size_t quantum) : mQuantum(quantum) {}
+
+    bool empty() const { return mActive.empty(); }
+
+    void push(const K& k, T&& v, std::size_t cost) {
+        auto it = mLanes.find(k);
+        if (it == mLanes.end()) {
+            it = mLanes.emplace(k, Lane()).first;
+            mActive.emplace_back(k);
+        }
+        it->second.items.emplace_back(std::move(v), cost);
+    }
+
+    // Must not be called when empty()
+    T pop() {
+        while (true) {
+            auto it = mLanes.find(mActive.front());
+            Lane& lane = it->second;
+
+            if (!lane.credited) {
+                lane.deficit += mQuantum;
+                lane.credited = true;
+            }
+
+            if (lane.items.front().second <= lane.deficit) {
+                lane.deficit -= lane.items.front().second;
+                T v = std::move(lane.items.front().first);
+                lane.items.pop_front();
+
+                // An idle lane loses its remaining credit
+                if (lane.items.empty()) {
+                    mLanes.erase(it);
+                    mActive.pop_front();
+                }
+
+                return v;
+            }
+
+            // Not enough credit left, move on to the next lane
+            lane.credited = false;
+            mActive.emplace_back(mActive.front());
+            mActive.pop_front();
+        }
+    }
+
+    // Removes every item, each lane in FIFO order
+    template <typename F>
+    void drain(F&& f) {
+        for (const K& k : mActive) {
+            for (auto& item : mLanes[k].items)
+                f(std::move(item.first));
+        }
+        mLanes.clear();
+        mActive.clear();
+    }
+
+  private:
+    struct Lane {
+        std::deque<std::pair<T, std::size_t>> items;
+        std::size_t deficit = 0;
+        bool credited = false;
+    };
+
+    std::size_t mQuantum;
+
+    std::unordered_map<K, Lane> mLanes;
+    std::deque<K> mActive;
+};
+
+}  // namespace Protocon
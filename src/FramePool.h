@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Protocon/PayloadWriter.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Protocon {
+
+// Recycles the frame buffers behind PayloadWriter. Writers are filled on the
+// user thread and released on the Sender thread once written.
+class FramePool : public std::enable_shared_from_this<FramePool> {
+  public:
+    PayloadWriter acquire() {
+        std::vector<char> frame;
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            if (!mIdle.empty()) {
+                frame = std::move(mIdle.back());
+                mIdle.pop_back();
+            }
+        }
+
+        frame.resize(PayloadWriter::HeaderRoom);
+        return PayloadWriter(std::move(frame), shared_from_this());
+    }
+
+    void release(std::vector<char>&& frame) {
+        // Oversized buffers aren't worth keeping around
+        if (frame.capacity() > MaxIdleCapacity) return;
+
+        frame.clear();
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (mIdle.size() < MaxIdle) mIdle.emplace_back(std::move(frame));
+    }
+
+  private:
+    static constexpr std::size_t MaxIdle = 64;
+    static constexpr std::size_t MaxIdleCapacity = 4 << 20;
+
+    std::mutex mMtx;
+    std::vector<std::vector<char>> mIdle;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,72 @@
+#include <Protocon/JsonPayload.h>
+#include <simdjson.h>
+#include <spdlog/spdlog.h>
+
+namespace Protocon {
+
+// This is a C++14 build: std::string_view only exists when the standard
+// library has it, otherwise simdjson brings its own
+#ifdef SIMDJSON_HAS_STRING_VIEW
+using StringView = std::string_view;
+#else
+using StringView = nonstd::string_view;
+#endif
+
+static_assert(JsonPayload::Padding >= simdjson::SIMDJSON_PADDING, "Payload padding too small for simdjson");
+
+struct JsonPayload::Impl {
+    simdjson::padded_string copy;
+    simdjson::ondemand::document doc;
+    bool valid = false;
+
+    template <typename T>
+    bool get(const char* key, T& value) {
+        if (!valid) return false;
+
+        // Fields may come in any order, a lookup resumes after the last one
+        // and wraps around if needed
+        return !doc.find_field_unordered(key).get(value);
+    }
+};
+
+static simdjson::ondemand::parser& Parser() {
+    static thread_local simdjson::ondemand::parser parser;
+    return parser;
+}
+
+JsonPayload::JsonPayload(const std::string& data) : mImpl(std::make_unique<Impl>()) {
+    simdjson::error_code error;
+    if (data.capacity() - data.size() >= simdjson::SIMDJSON_PADDING) {
+        error = Parser().iterate(simdjson::padded_string_view(data.data(), data.size(), data.capacity())).get(mImpl->doc);
+    } else {
+        mImpl->copy = simdjson::padded_string(data);
+        error = Parser().iterate(mImpl->copy).get(mImpl->doc);
+    }
+
+    if (error) {
+        spdlog::warn("Failed to parse JSON payload, details: {}", simdjson::error_message(error));
+        return;
+    }
+
+    mImpl->valid = true;
+}
+
+JsonPayload::~JsonPayload() {}
+
+bool JsonPayload::get(const char* key, int64_t& value) { return mImpl->get(key, value); }
+
+bool JsonPayload::get(const char* key, uint64_t& value) { return mImpl->get(key, value); }
+
+bool JsonPayload::get(const char* key, double& value) { return mImpl->get(key, value); }
+
+bool JsonPayload::get(const char* key, bool& value) { return mImpl->get(key, value); }
+
+bool JsonPayload::get(const char* key, std::string& value) {
+    StringView view;
+    if (!mImpl->get(key, view)) return false;
+
+    value.assign(view.data(), view.size());
+    return true;
+}
+
+}  // namespace Protocon
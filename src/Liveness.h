@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Protocon/HeartbeatOptions.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace Protocon {
+
+// What the Receiver learns about the peer: when it was last heard from, and
+// the round trip estimate from heartbeat acks, smoothed as in RFC 6298.
+// Read by poll().
+class Liveness {
+  public:
+    // Heartbeat timestamps, steady clock nanoseconds
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mStats = RttStats{};
+        mLastHeard = Now();
+    }
+
+    void heard() { mLastHeard.store(Now(), std::memory_order_relaxed); }
+
+    std::chrono::nanoseconds silence() const {
+        return std::chrono::nanoseconds(Now() - mLastHeard.load(std::memory_order_relaxed));
+    }
+
+    void sample(std::chrono::microseconds rtt) {
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (!mStats.samples) {
+            mStats.srtt = rtt;
+            mStats.rttvar = rtt / 2;
+        } else {
+            auto delta = mStats.srtt > rtt ? mStats.srtt - rtt : rtt - mStats.srtt;
+            mStats.rttvar = (3 * mStats.rttvar + delta) / 4;
+            mStats.srtt = (7 * mStats.srtt + rtt) / 8;
+        }
+        mStats.rto = mStats.srtt + 4 * mStats.rttvar;
+        mStats.samples++;
+    }
+
+    RttStats stats() const {
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mStats;
+    }
+
+  private:
+    mutable std::mutex mMtx;
+    RttStats mStats{};
+    std::atomic<uint64_t> mLastHeard{Now()};
+};
+
+}  // namespace Protocon
@@ -0,0 +1,28 @@
+#include <Protocon/PayloadWriter.h>
+
+#include <utility>
+
+#include "FramePool.h"
+
+namespace Protocon {
+
+PayloadWriter::PayloadWriter() {}
+
+PayloadWriter::PayloadWriter(std::vector<char> frame, std::shared_ptr<FramePool> pool)
+    : mFrame(std::move(frame)), mPool(std::move(pool)) {}
+
+PayloadWriter::PayloadWriter(PayloadWriter&& writer) = default;
+
+PayloadWriter& PayloadWriter::operator=(PayloadWriter&& writer) {
+    if (mPool) mPool->release(std::move(mFrame));
+
+    mFrame = std::move(writer.mFrame);
+    mPool = std::move(writer.mPool);
+    return *this;
+}
+
+PayloadWriter::~PayloadWriter() {
+    if (mPool) mPool->release(std::move(mFrame));
+}
+
+}  // namespace Protocon
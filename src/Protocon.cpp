@@ -1,51 +1,123 @@
 #include <Protocon/Protocon.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cinttypes>
 #include <cstddef>
 #include <cstdio>
+#include <ctime>
 #include <memory>
+#include <stdexcept>
 #include <thread>
 
+#include "Capture.h"
+#include "FramePool.h"
+#include "Liveness.h"
 #include "Receiver.h"
+#include "ResponseCache.h"
 #include "Sender.h"
 #include "Socket.h"
+#include "SpillQueue.h"
 #include "ThreadSafeQueue.h"
 #include "ThreadSafeUnorderedMap.h"
+#include "Tracer.h"
+#include "Transport.h"
 #include "Util.h"
 
+#ifdef PROTOCON_IO_URING
+#include "UringTransport.h"
+#endif
+
+#ifdef __linux__
+#include "ShmTransport.h"
+#endif
+
 namespace Protocon {
 
+static std::unique_ptr<Transport> MakeTransport(TransportType type, const TransportProfile& profile) {
+    switch (type) {
+        case TransportType::IoUring:
+#ifdef PROTOCON_IO_URING
+            return std::make_unique<UringTransport>(profile);
+#else
+            spdlog::warn("io_uring transport is not built in, using asio instead");
+            return std::make_unique<Socket>(profile);
+#endif
+        case TransportType::Unix:
+#ifndef _WIN32
+            return std::make_unique<UnixSocket>(profile);
+#else
+            spdlog::warn("Unix domain sockets aren't supported on this platform");
+            return nullptr;
+#endif
+        case TransportType::SharedMemory:
+#ifdef __linux__
+            return std::make_unique<ShmTransport>();
+#else
+            spdlog::warn("Shared memory transport isn't supported on this platform");
+            return nullptr;
+#endif
+        default:
+            return std::make_unique<Socket>(profile);
+    }
+}
+
 Gateway::Gateway(Gateway&& gateway) = default;
 
 Gateway::~Gateway() {}
 
 bool Gateway::isOpen() const {
-    return mSocket->is_open();
+    return mTransport && mReceiver && mTransport->is_open() && mReceiver->running();
 }
 
 bool Gateway::run(const char* host, uint16_t port) {
-    mSocket = std::make_unique<Socket>();
-    if (!mSocket->connect(host, port))
+    return run({Endpoint{host, port}});
+}
+
+bool Gateway::run(const std::vector<Endpoint>& endpoints) {
+    mTransport = MakeTransport(mTransportType, mTransportProfile);
+    if (!mTransport || !mTransport->connectAny(endpoints))
         return false;
 
     mRequestRx = std::make_unique<ThreadSafeQueue<RawRequest>>();
     mResponseRx = std::make_unique<ThreadSafeQueue<RawResponse>>();
 
-    mRequestTx = std::make_unique<ThreadSafeQueue<RawRequest>>();
+    // With a spill, requests left over by stop() go out first
+    if (!mSpill) mRequestTx = std::make_unique<ThreadSafeQueue<RawRequest>>();
     mResponseTx = std::make_unique<ThreadSafeQueue<RawResponse>>();
+    mHeartbeatTx = std::make_unique<ThreadSafeQueue<RawHeartbeat>>();
+
+    if (mLiveness) {
+        mLiveness->reset();
+        mLastHeartbeat = std::chrono::steady_clock::time_point();
+    }
+
+    if (!mCapturePath.empty()) {
+        mCapture = std::make_unique<CaptureWriter>();
+        if (!mCapture->open(mCapturePath))
+            mCapture.reset();
+    }
 
+    const bool admissionControlled = mAdmission.maxQueuedRequests || mAdmission.maxRequestAge.count();
     mReceiver = std::make_unique<Receiver>(
-        mSocket->socket(), *mRequestRx, *mResponseRx,
-        *mSignUpResponseRx, *mSignInResponseRx);
+        *mTransport, *mRequestRx, *mResponseRx,
+        *mSignUpResponseRx, *mSignInResponseRx,
+        mCapture.get(), mTracer.get(),
+        mAdmission, admissionControlled ? mResponseTx.get() : nullptr,
+        mReceiverThread, mLiveness.get(),
+        [this](uint16_t type) { return handles(type); });
     mReceiver->run();
 
     mSender = std::make_unique<Sender>(
-        mSocket->socket(),
+        *mTransport,
         *mRequestTx, *mResponseTx,
-        *mSignUpRequestTx, *mSignInRequestTx);
+        *mSignUpRequestTx, *mSignInRequestTx,
+        mTransportProfile,
+        mCapture.get(), mTracer.get(),
+        mSpill.get(), mSenderThread,
+        mLiveness ? mHeartbeatTx.get() : nullptr);
     mSender->run();
 
     for (const auto& it : mClientIdTokenMap)
@@ -58,38 +130,162 @@ bool Gateway::run(const char* host, uint16_t port) {
 }
 
 void Gateway::stop() {
-    mSocket->shutdown();
-    mSocket.reset();
+    mTransport->shutdown();
 
+    // Both threads hold on to the transport until they are joined
     mReceiver->stop();
     mSender->stop();
+
+    mTransport.reset();
+
+    // Whatever the Sender didn't get to waits in memory for the next run().
+    // It is older than anything spilled, the Sender's lane most of all.
+    if (mSpill) {
+        auto requestTx = std::make_unique<ThreadSafeQueue<RawRequest>>();
+        mSender->drainUnsent([&requestTx](RawRequest&& r) { requestTx->emplace(std::move(r)); });
+        while (!mRequestTx->empty())
+            requestTx->emplace(mRequestTx->pop());
+        mRequestTx = std::move(requestTx);
+    }
+
+    if (mCapture) mCapture->close();
 }
 
 void Gateway::poll() {
+    if (mLiveness) checkLiveness();
+
+    // Control responses go first, so that requests for a client which has
+    // just been registered aren't dropped
+    pollSignUpResponses();
+
+    while (!mSignInResponseRx->empty()) {
+        RawSignInResponse r = mSignInResponseRx->pop();
+
+        if (!r.response.status)
+            spdlog::info("Login successed");
+        else
+            spdlog::warn("Login failed, status code: 0x{:x}", r.response.status);
+
+        mSignInResponseHandler(r.response);
+    }
+
     while (!mRequestRx->empty()) {
         RawRequest r = mRequestRx->pop();
 
+        // The Receiver queues a client's registration before its requests,
+        // it may have arrived after the loop above
         auto clientIdIt = mClientIdTokenMap.find(r.clientId);
-        auto handlerIt = mRequestHandlerMap.find(r.request.type);
-        if (clientIdIt != mClientIdTokenMap.end() && handlerIt != mRequestHandlerMap.end())
-            mResponseTx->emplace(
-                RawResponse{
-                    r.cmdId,
-                    (handlerIt->second)(ClientToken(clientIdIt->second), r.request)});
+        if (clientIdIt == mClientIdTokenMap.end()) {
+            pollSignUpResponses();
+            clientIdIt = mClientIdTokenMap.find(r.clientId);
+        }
+
+        if (clientIdIt == mClientIdTokenMap.end()) continue;
+
+        const bool isStatic = mStaticHandles && mStaticHandles(r.request.type);
+        auto handlerIt = isStatic ? mRequestHandlerMap.end() : mRequestHandlerMap.find(r.request.type);
+        auto writerIt = isStatic ? mWriterRequestHandlerMap.end() : mWriterRequestHandlerMap.find(r.request.type);
+        if (!isStatic && handlerIt == mRequestHandlerMap.end() && writerIt == mWriterRequestHandlerMap.end())
+            continue;
+
+        // The caller may have given up while the request was queued
+        if (Receiver::Expired(mAdmission, r.request.time)) {
+            mShedRequests++;
+            mResponseTx->emplace(RawResponse{r.cmdId, Response{static_cast<uint64_t>(std::time(nullptr)), mAdmission.busyStatus, ""}});
+            continue;
+        }
+
+        const uint32_t traceKey = Tracer::Key(Tracer::Inbound, r.cmdId);
+        if (mTracer) mTracer->record(Tracer::User, traceKey, TraceStage::Dispatch);
+
+        RawResponse response{r.cmdId};
+        if (isStatic) {
+            mStaticDispatch(mStaticDispatcher.get(), ClientToken(clientIdIt->second), r.request, response.response);
+        } else if (handlerIt != mRequestHandlerMap.end()) {
+            response.response = handleRequest(ClientToken(clientIdIt->second), r.request, handlerIt->second);
+        } else {
+            response.payload = mFramePool->acquire();
+            uint8_t status = writerIt->second(ClientToken(clientIdIt->second), r.request, response.payload);
+            response.response = Response{static_cast<uint64_t>(std::time(nullptr)), status, ""};
+        }
+
+        if (mTracer) mTracer->record(Tracer::User, traceKey, TraceStage::Complete);
+
+        mResponseTx->emplace(std::move(response));
     }
 
     while (!mResponseRx->empty()) {
         RawResponse r = mResponseRx->pop();
 
         auto it = mRequestResponseHandlerMap.find(r.cmdId);
+        if (it == mRequestResponseHandlerMap.end()) {
+            spdlog::warn("Unexpected response, command ID: {}", r.cmdId);
+            continue;
+        }
+
+        if (mLiveness) mPendingSince.erase(r.cmdId);
+
+        const uint32_t traceKey = Tracer::Key(Tracer::Outbound, r.cmdId);
+        if (mTracer) mTracer->record(Tracer::User, traceKey, TraceStage::Dispatch);
+
         it->second(r.response);
         mRequestResponseHandlerMap.erase(it);
+
+        if (mTracer) mTracer->record(Tracer::User, traceKey, TraceStage::Complete);
+    }
+}
+
+void Gateway::checkLiveness() {
+    auto now = std::chrono::steady_clock::now();
+
+    if (isOpen()) {
+        // Shutting the transport down unblocks the Receiver, isOpen() turns
+        // false and the caller can fail over
+        if (mLiveness->silence() > mHeartbeat.deadTimeout) {
+            spdlog::warn("Nothing received from the server for {} ms, closing the connection",
+                         std::chrono::duration_cast<std::chrono::milliseconds>(mLiveness->silence()).count());
+            mTransport->shutdown();
+        } else if (now - mLastHeartbeat >= mHeartbeat.interval) {
+            mHeartbeatTx->emplace(RawHeartbeat{nextCmdId(), mGatewayId});
+            mLastHeartbeat = now;
+        }
+    }
+
+    const auto timeout = requestTimeout();
+    while (!mPendingRequests.empty() && now - mPendingRequests.front().first >= timeout) {
+        auto pending = mPendingRequests.front();
+        mPendingRequests.pop_front();
+
+        // Answered already, or the cmdId has been reused since
+        auto sinceIt = mPendingSince.find(pending.second);
+        if (sinceIt == mPendingSince.end() || sinceIt->second != pending.first) continue;
+        mPendingSince.erase(sinceIt);
+
+        auto it = mRequestResponseHandlerMap.find(pending.second);
+        if (it == mRequestResponseHandlerMap.end()) continue;
+
+        ResponseHandler handler = std::move(it->second);
+        mRequestResponseHandlerMap.erase(it);
+        handler(Response{static_cast<uint64_t>(std::time(nullptr)), mHeartbeat.timeoutStatus, ""});
     }
+}
+
+std::chrono::steady_clock::duration Gateway::requestTimeout() const {
+    RttStats stats = mLiveness->stats();
+    if (!stats.samples) return mHeartbeat.maxRequestTimeout;
 
+    return std::min<std::chrono::steady_clock::duration>(
+        std::max<std::chrono::steady_clock::duration>(stats.rto, mHeartbeat.minRequestTimeout),
+        mHeartbeat.maxRequestTimeout);
+}
+
+void Gateway::pollSignUpResponses() {
     while (!mSignUpResponseRx->empty()) {
         RawSignUpResponse r = mSignUpResponseRx->pop();
 
-        if (!r.response.status) {
+        if (!r.response.status && mAnonymousTokens.empty()) {
+            spdlog::warn("Unexpected registration, client Id: {}", r.response.clientId);
+        } else if (!r.response.status) {
             auto tk = mAnonymousTokens.back();
             mAnonymousTokens.pop_back();
             mTokenClientIdMap[tk] = r.response.clientId;
@@ -103,35 +299,220 @@ void Gateway::poll() {
             spdlog::warn("Registration failed, status code: 0x{:x}", r.response.status);
         }
     }
+}
 
-    while (!mSignInResponseRx->empty()) {
-        RawSignInResponse r = mSignInResponseRx->pop();
+void Gateway::send(ClientToken tk, Request&& r, ResponseHandler&& handler) {
+    const uint16_t cmdId = nextCmdId();
 
-        if (!r.response.status)
-            spdlog::info("Login successed");
-        else
-            spdlog::warn("Login failed, status code: 0x{:x}", r.response.status);
+    uint64_t clientId = mTokenClientIdMap.at(tk);
 
-        mSignInResponseHandler(r.response);
-    }
+    expectResponse(cmdId, std::move(handler));
+
+    if (mTracer) mTracer->record(Tracer::User, Tracer::Key(Tracer::Outbound, cmdId), TraceStage::Enqueue);
+
+    enqueueRequest(RawRequest{cmdId, mGatewayId, clientId, mApiVersion, std::move(r)});
 }
 
-void Gateway::send(ClientToken tk, Request&& r, ResponseHandler&& handler) {
+void Gateway::send(ClientToken tk, uint16_t type, PayloadWriter&& payload, ResponseHandler&& handler) {
     const uint16_t cmdId = nextCmdId();
 
     uint64_t clientId = mTokenClientIdMap.at(tk);
 
+    expectResponse(cmdId, std::move(handler));
+
+    if (mTracer) mTracer->record(Tracer::User, Tracer::Key(Tracer::Outbound, cmdId), TraceStage::Enqueue);
+
+    enqueueRequest(RawRequest{
+        cmdId, mGatewayId, clientId, mApiVersion,
+        Request{static_cast<uint64_t>(std::time(nullptr)), type, ""},
+        std::move(payload)});
+}
+
+void Gateway::broadcast(const std::vector<ClientToken>& tks, Request&& r, BroadcastResponseHandler&& handler) {
+    PayloadWriter payload = createPayloadWriter();
+    payload.append(r.data);
+    broadcast(tks, r.type, std::move(payload), std::move(handler));
+}
+
+void Gateway::broadcast(const std::vector<ClientToken>& tks, uint16_t type, PayloadWriter&& payload,
+                        BroadcastResponseHandler&& handler) {
+    auto shared = std::make_shared<BroadcastResponseHandler>(std::move(handler));
+
+    enqueueBroadcast(tks, type, std::move(payload), [&shared](ClientToken tk, std::size_t) -> ResponseHandler {
+        return [tk, shared](const Response& r) { (*shared)(tk, r); };
+    });
+}
+
+void Gateway::broadcastCollect(const std::vector<ClientToken>& tks, Request&& r, BroadcastCompletionHandler&& handler) {
+    if (tks.empty()) {
+        handler({});
+        return;
+    }
+
+    struct Collector {
+        std::vector<std::pair<ClientToken, Response>> responses;
+        std::size_t remaining;
+        BroadcastCompletionHandler handler;
+    };
+    auto collector = std::make_shared<Collector>();
+    collector->responses.resize(tks.size());
+    collector->remaining = tks.size();
+    collector->handler = std::move(handler);
+
+    PayloadWriter payload = createPayloadWriter();
+    payload.append(r.data);
+
+    enqueueBroadcast(tks, r.type, std::move(payload), [&collector](ClientToken tk, std::size_t i) -> ResponseHandler {
+        return [collector, tk, i](const Response& r) {
+            collector->responses[i] = std::make_pair(tk, r);
+            if (!--collector->remaining) collector->handler(collector->responses);
+        };
+    });
+}
+
+template <typename F>
+void Gateway::enqueueBroadcast(const std::vector<ClientToken>& tks, uint16_t type, PayloadWriter&& payload, F handlerOf) {
+    // Nothing is sent unless every client can be, a partial broadcast would
+    // leave broadcastCollect() waiting forever
+    if (tks.size() > CmdIdSpace - mRequestResponseHandlerMap.size())
+        throw std::length_error("broadcast to more clients than there are free command IDs");
+    std::vector<uint64_t> clientIds;
+    clientIds.reserve(tks.size());
+    for (const auto& tk : tks)
+        clientIds.push_back(mTokenClientIdMap.at(tk));
+
+    auto shared = std::make_shared<PayloadWriter>(std::move(payload));
+    const uint64_t time = std::time(nullptr);
+
+    for (std::size_t i = 0; i < tks.size(); i++) {
+        const uint16_t cmdId = nextCmdId();
+
+        uint64_t clientId = clientIds[i];
+
+        expectResponse(cmdId, handlerOf(tks[i], i));
+
+        if (mTracer) mTracer->record(Tracer::User, Tracer::Key(Tracer::Outbound, cmdId), TraceStage::Enqueue);
+
+        enqueueRequest(RawRequest{
+            cmdId, mGatewayId, clientId, mApiVersion,
+            Request{time, type, ""},
+            PayloadWriter(), shared});
+    }
+}
+
+void Gateway::expectResponse(uint16_t cmdId, ResponseHandler&& handler) {
     mRequestResponseHandlerMap.emplace(cmdId, std::move(handler));
-    mRequestTx->emplace(RawRequest{cmdId, mGatewayId, clientId, mApiVersion, std::move(r)});
+
+    if (mLiveness) {
+        auto now = std::chrono::steady_clock::now();
+        mPendingRequests.emplace_back(now, cmdId);
+        mPendingSince[cmdId] = now;
+    }
+}
+
+void Gateway::enqueueRequest(RawRequest&& r) {
+    // Once anything is spilled, later requests queue up behind it to keep
+    // them in order
+    if (mSpill && (!isOpen() || mRequestTx->size() >= mSpillMaxQueuedRequests || mSpill->size())) {
+        if (mSpill->push(r)) return;
+        spdlog::warn("Failed to spill request, keeping it in memory");
+    }
+
+    mRequestTx->emplace(std::move(r));
+}
+
+PayloadWriter Gateway::createPayloadWriter() {
+    return mFramePool->acquire();
+}
+
+std::size_t Gateway::shedRequests() const {
+    return mShedRequests + (mReceiver ? mReceiver->shedRequests() : 0);
+}
+
+bool Gateway::handles(uint16_t type) const {
+    return (mStaticHandles && mStaticHandles(type)) ||
+           mRequestHandlerMap.count(type) || mWriterRequestHandlerMap.count(type);
+}
+
+void Gateway::setStaticDispatch(std::shared_ptr<void> dispatcher, StaticDispatch dispatch, StaticHandles handles) {
+    mStaticDispatcher = std::move(dispatcher);
+    mStaticDispatch = dispatch;
+    mStaticHandles = handles;
+}
+
+std::size_t Gateway::spilledRequests() const {
+    return mSpill ? mSpill->size() : 0;
+}
+
+RttStats Gateway::rttStats() const {
+    return mLiveness ? mLiveness->stats() : RttStats{};
+}
+
+void Gateway::invalidateResponseCache(uint16_t type) {
+    auto it = mResponseCacheMap.find(type);
+    if (it != mResponseCacheMap.end())
+        it->second->clear();
+}
+
+void Gateway::invalidateResponseCache(uint16_t type, const std::string& data) {
+    auto it = mResponseCacheMap.find(type);
+    if (it != mResponseCacheMap.end())
+        it->second->erase(data);
+}
+
+bool Gateway::writeTrace(const std::string& path) const {
+    if (!mTracer) {
+        spdlog::warn("Tracing is not enabled, see GatewayBuilder::withTracing()");
+        return false;
+    }
+
+    return mTracer->writeChromeTrace(path);
+}
+
+std::vector<TraceHistogram> Gateway::traceHistograms() const {
+    if (!mTracer) return {};
+
+    return mTracer->histograms();
 }
 
 Gateway::Gateway(uint16_t apiVersion, uint64_t gatewayId,
                  SignUpResponseHandler SignUpResponseHandler, SignInResponseHandler SignInResponseHandler,
-                 std::vector<std::pair<uint16_t, RequestHandler>> requestHandlers)
-    : mApiVersion(apiVersion), mGatewayId(gatewayId), mSignUpResponseHandler(SignUpResponseHandler), mSignInResponseHandler(SignInResponseHandler) {
+                 std::vector<std::pair<uint16_t, RequestHandler>> requestHandlers,
+                 std::vector<std::pair<uint16_t, WriterRequestHandler>> writerRequestHandlers,
+                 std::vector<ResponseCacheOptions> responseCaches,
+                 std::string capturePath,
+                 TransportType transportType,
+                 TransportProfile transportProfile,
+                 std::size_t traceCapacity,
+                 AdmissionOptions admission,
+                 SpillOptions spill,
+                 ThreadOptions receiverThread,
+                 ThreadOptions senderThread,
+                 HeartbeatOptions heartbeat)
+    : mApiVersion(apiVersion), mGatewayId(gatewayId), mSignUpResponseHandler(SignUpResponseHandler), mSignInResponseHandler(SignInResponseHandler), mCapturePath(std::move(capturePath)), mAdmission(admission), mSpillMaxQueuedRequests(spill.maxQueuedRequests), mHeartbeat(heartbeat), mTransportType(transportType), mTransportProfile(transportProfile), mReceiverThread(std::move(receiverThread)), mSenderThread(std::move(senderThread)) {
     for (auto&& h : requestHandlers)
         mRequestHandlerMap.emplace(h.first, std::move(h.second));
 
+    for (auto&& h : writerRequestHandlers)
+        mWriterRequestHandlerMap.emplace(h.first, std::move(h.second));
+
+    mFramePool = std::make_shared<FramePool>();
+
+    for (const auto& c : responseCaches)
+        mResponseCacheMap[c.type] = std::make_unique<ResponseCache>(c.ttl, c.capacity);
+
+    if (traceCapacity)
+        mTracer = std::make_unique<Tracer>(traceCapacity);
+
+    if (heartbeat.interval.count())
+        mLiveness = std::make_unique<Liveness>();
+
+    if (!spill.directory.empty()) {
+        mSpill = std::make_unique<SpillQueue>(std::move(spill.directory), spill.segmentSize);
+        if (!mSpill->open())
+            mSpill.reset();
+    }
+
     mRequestRx = std::make_unique<ThreadSafeQueue<RawRequest>>();
     mResponseRx = std::make_unique<ThreadSafeQueue<RawResponse>>();
     mSignUpResponseRx = std::make_unique<ThreadSafeQueue<RawSignUpResponse>>();
@@ -141,6 +522,26 @@ Gateway::Gateway(uint16_t apiVersion, uint64_t gatewayId,
     mResponseTx = std::make_unique<ThreadSafeQueue<RawResponse>>();
     mSignUpRequestTx = std::make_unique<ThreadSafeQueue<RawSignUpRequest>>();
     mSignInRequestTx = std::make_unique<ThreadSafeQueue<RawSignInRequest>>();
+    mHeartbeatTx = std::make_unique<ThreadSafeQueue<RawHeartbeat>>();
+}
+
+Response Gateway::handleRequest(ClientToken tk, const Request& r, const RequestHandler& handler) {
+    auto cacheIt = mResponseCacheMap.find(r.type);
+    if (cacheIt == mResponseCacheMap.end())
+        return handler(tk, r);
+
+    ResponseCache& cache = *cacheIt->second;
+    const std::size_t hash = ResponseCache::Hash(r.data);
+    if (const Response* cached = cache.find(r.data, hash)) {
+        Response response = *cached;
+        response.time = static_cast<uint64_t>(std::time(nullptr));
+        return response;
+    }
+
+    Response response = handler(tk, r);
+    // A failure may be transient, it shouldn't be served for the whole TTL
+    if (response.status == 0x00) cache.insert(r.data, hash, response);
+    return response;
 }
 
 void Gateway::sendSignUpRequest() {
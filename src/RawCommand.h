@@ -1,11 +1,13 @@
 #pragma once
 
+#include <Protocon/PayloadWriter.h>
 #include <Protocon/Request.h>
 #include <Protocon/Response.h>
 #include <Protocon/SignInResponse.h>
 #include <Protocon/SignUpResponse.h>
 
 #include <cstdint>
+#include <memory>
 
 
 namespace Protocon {
@@ -16,11 +18,17 @@ struct RawRequest {
     uint64_t clientId;
     uint16_t apiVersion;
     Request request;
+    // Replaces request.data when it came from a PayloadWriter
+    PayloadWriter payload;
+    // Replaces both for broadcasts, one frame buffer for all their clients
+    std::shared_ptr<PayloadWriter> sharedPayload;
 };
 
 struct RawResponse {
     uint16_t cmdId;
     Response response;
+    // Replaces response.data when it came from a PayloadWriter
+    PayloadWriter payload;
 };
 
 struct RawSignInRequest {
@@ -39,6 +47,12 @@ struct RawSignUpRequest {
     uint64_t gatewayId;
 };
 
+// The Sender stamps the time when it encodes the frame
+struct RawHeartbeat {
+    uint16_t cmdId;
+    uint64_t gatewayId;
+};
+
 struct RawSignUpResponse {
     uint16_t cmdId;
     SignUpResponse response;
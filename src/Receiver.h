@@ -1,44 +1,90 @@
 #pragma once
 
+#include <Protocon/AdmissionOptions.h>
+#include <Protocon/JsonPayload.h>
+#include <Protocon/ThreadOptions.h>
 #include <spdlog/spdlog.h>
 
-#include <array>
-#include <asio/buffer.hpp>
-#include <asio/ip/tcp.hpp>
-#include <asio/read.hpp>
-#include <asio/system_error.hpp>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
+#include "Backoff.h"
+#include "BatchFrame.h"
+#include "Capture.h"
+#include "Liveness.h"
 #include "Protocon/SignUpResponse.h"
 #include "RawCommand.h"
+#include "ThreadPlacement.h"
 #include "ThreadSafeQueue.h"
+#include "Tracer.h"
+#include "Transport.h"
 #include "Util.h"
 
 namespace Protocon {
 
 class Receiver {
   public:
-    Receiver(asio::ip::tcp::socket& socket,
+    Receiver(Transport& transport,
              ThreadSafeQueue<RawRequest>& requestTx,
              ThreadSafeQueue<RawResponse>& responseTx,
              ThreadSafeQueue<RawSignUpResponse>& signUpResponseTx,
-             ThreadSafeQueue<RawSignInResponse>& signInResponseTx)
-        : mSocket(socket),
+             ThreadSafeQueue<RawSignInResponse>& signInResponseTx,
+             CaptureWriter* capture = nullptr,
+             Tracer* tracer = nullptr,
+             const AdmissionOptions& admission = AdmissionOptions(),
+             ThreadSafeQueue<RawResponse>* busyResponseTx = nullptr,
+             const ThreadOptions& threadOptions = ThreadOptions(),
+             Liveness* liveness = nullptr,
+             std::function<bool(uint16_t)> handles = nullptr)
+        : mTransport(transport),
           mRequestTx(requestTx),
           mResponseTx(responseTx),
           mSignUpResponseTx(signUpResponseTx),
-          mSignInResponseTx(signInResponseTx) {}
+          mSignInResponseTx(signInResponseTx),
+          mCapture(capture),
+          mTracer(tracer),
+          mAdmission(admission),
+          mBusyResponseTx(busyResponseTx),
+          mThreadOptions(threadOptions),
+          mLiveness(liveness),
+          mHandles(std::move(handles)) {}
+
+    // False once the read loop has exited, either by stop() or by error
+    bool running() const { return mRunning; }
+
+    // Requests answered as busy so far
+    std::size_t shedRequests() const { return mShedRequests; }
+
+    // Whether a request sent at `time` (seconds since epoch) is too old
+    static bool Expired(const AdmissionOptions& admission, uint64_t time) {
+        if (!admission.maxRequestAge.count()) return false;
+
+        auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        return now > 0 && static_cast<uint64_t>(now) > time + admission.maxRequestAge.count();
+    }
 
     void run() {
         mStopFlag = false;
+        mRunning = true;
 
         mHandle = std::thread([this] {
+            ThreadPlacement::Apply(mThreadOptions);
+
             while (!mStopFlag) {
+                mFrame.clear();
+
                 uint8_t cmdFlag;
                 if (!read(&cmdFlag, sizeof(cmdFlag))) break;
 
@@ -54,16 +100,28 @@ class Receiver {
                     if (!receiveSignUpResponse(cmdId)) break;
                 } else if (cmdFlag == 0x82) {
                     if (!receiveSignInResponse(cmdId)) break;
+                } else if (cmdFlag == 0x83) {
+                    if (!receiveHeartbeatAck()) break;
+                } else if (cmdFlag == BatchFrame::Flag) {
+                    // The command count takes the place of the command ID
+                    if (!receiveBatch(cmdId)) break;
                 } else {
                     spdlog::warn("Unknown command flag, please contact the developer");
                     break;
                 }
+
+                if (mCapture)
+                    mCapture->append(Capture::Inbound, mFrame.data(), mFrame.size());
+
+                if (mLiveness) mLiveness->heard();
             }
 
             if (mStopFlag)
                 spdlog::info("Reader closed by shutdown");
             else
                 spdlog::warn("Reader closed by error");
+
+            mRunning = false;
         });
     }
 
@@ -73,15 +131,56 @@ class Receiver {
     }
 
   private:
+    // Reads exactly n bytes, served from mRxBuf so that one transport read
+    // usually covers many frames
     inline bool read(void* buf, size_t n) {
-        std::size_t len;
-        try {
-            len = asio::read(mSocket, asio::buffer(buf, n));
-        } catch (std::exception& e) {
-            spdlog::warn("Reader error occurs, details: {}", e.what());
-            return false;
+        char* p = static_cast<char*>(buf);
+
+        while (n) {
+            std::size_t len;
+            if (mRxBegin == mRxEnd && n >= mRxBuf.size()) {
+                // Large payloads bypass the buffer
+                spin();
+                len = mTransport.read(p, n);
+                if (!len) return false;
+            } else {
+                if (mRxBegin == mRxEnd) {
+                    spin();
+                    mRxBegin = 0;
+                    mRxEnd = mTransport.read(mRxBuf.data(), mRxBuf.size());
+                    if (!mRxEnd) return false;
+                }
+
+                len = std::min(n, mRxEnd - mRxBegin);
+                std::memcpy(p, mRxBuf.data() + mRxBegin, len);
+                mRxBegin += len;
+            }
+
+            if (mCapture) mFrame.insert(mFrame.end(), p, p + len);
+
+            p += len;
+            n -= len;
         }
-        return len;
+
+        return true;
+    }
+
+    // Requests the gateway would drop anyway are never answered as busy
+    inline bool admit(uint16_t type, uint64_t time) {
+        if (!mBusyResponseTx) return true;
+        if (mHandles && !mHandles(type)) return true;
+
+        if (mAdmission.maxQueuedRequests && mRequestTx.size() >= mAdmission.maxQueuedRequests) return false;
+
+        return !Expired(mAdmission, time);
+    }
+
+    // Spare capacity lets JsonPayload parse the payload in place
+    static std::string payload(uint32_t length) {
+        std::string data;
+        data.reserve(length + JsonPayload::Padding);
+        data.resize(length);
+        return data;
     }
 
     inline bool receiveRequest(uint16_t cmdId) {
@@ -109,7 +208,22 @@ class Receiver {
         if (!read(&length, sizeof(length))) return false;
         length = Util::BigEndian(length);
 
-        if (!read(&mBuf, length)) return false;
+        std::string data = payload(length);
+        if (!read(&data[0], length)) return false;
+
+        deliverRequest(cmdId, gatewayId, clientId, apiVersion, time, type, std::move(data));
+        return true;
+    }
+
+    inline void deliverRequest(uint16_t cmdId, uint64_t gatewayId, uint64_t clientId, uint16_t apiVersion,
+                               uint64_t time, uint16_t type, std::string&& data) {
+        if (mTracer) mTracer->record(Tracer::Receiver, Tracer::Key(Tracer::Inbound, cmdId), TraceStage::Parse);
+
+        if (!admit(type, time)) {
+            mShedRequests++;
+            mBusyResponseTx->emplace(RawResponse{cmdId, Response{static_cast<uint64_t>(std::time(nullptr)), mAdmission.busyStatus, ""}});
+            return;
+        }
 
         mRequestTx.emplace(RawRequest{
             cmdId,
@@ -119,10 +233,18 @@ class Receiver {
             Request{
                 time,
                 type,
-                std::string(mBuf.data(), length),
+                std::move(data),
             }});
+    }
 
-        return true;
+    // With busy polling, waits for data in user space for a while before
+    // read() gets to block
+    inline void spin() {
+        if (!mThreadOptions.busyPoll) return;
+
+        mBackoff.reset();
+        while (!mStopFlag && !mTransport.readable() && mBackoff.spin())
+            ;
     }
 
     inline bool receiveResponse(uint16_t cmdId) {
@@ -137,19 +259,102 @@ class Receiver {
         if (!read(&length, sizeof(length))) return false;
         length = Util::BigEndian(length);
 
-        if (!read(&mBuf, length)) return false;
+        std::string data = payload(length);
+        if (!read(&data[0], length)) return false;
+
+        deliverResponse(cmdId, time, status, std::move(data));
+        return true;
+    }
+
+    inline void deliverResponse(uint16_t cmdId, uint64_t time, uint8_t status, std::string&& data) {
+        if (mTracer) mTracer->record(Tracer::Receiver, Tracer::Key(Tracer::Outbound, cmdId), TraceStage::Parse);
 
         mResponseTx.emplace(RawResponse{
             cmdId,
             Response{
                 time,
                 status,
-                std::string(mBuf.data(), length),
+                std::move(data),
             }});
+    }
+
+    // Unpacks every command of a batch frame, see BatchFrame
+    inline bool receiveBatch(uint16_t count) {
+        uint64_t gatewayId;
+        if (!read(&gatewayId, sizeof(gatewayId))) return false;
+        gatewayId = Util::BigEndian(gatewayId);
+
+        uint16_t apiVersion;
+        if (!read(&apiVersion, sizeof(apiVersion))) return false;
+        apiVersion = Util::BigEndian(apiVersion);
+
+        uint64_t time;
+        if (!read(&time, sizeof(time))) return false;
+        time = Util::BigEndian(time);
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint8_t flag;
+            if (!read(&flag, sizeof(flag))) return false;
+
+            uint16_t cmdId;
+            if (!read(&cmdId, sizeof(cmdId))) return false;
+            cmdId = Util::BigEndian(cmdId);
+
+            std::string data;
+            if (flag == 0x00) {
+                uint64_t clientId;
+                if (!readVarint(clientId)) return false;
+
+                uint16_t type;
+                if (!read(&type, sizeof(type))) return false;
+                type = Util::BigEndian(type);
+
+                if (!readPayload(data)) return false;
+
+                deliverRequest(cmdId, gatewayId, clientId, apiVersion, time, type, std::move(data));
+            } else if (flag == 0x80) {
+                uint8_t status;
+                if (!read(&status, sizeof(status))) return false;
+
+                if (!readPayload(data)) return false;
+
+                deliverResponse(cmdId, time, status, std::move(data));
+            } else {
+                spdlog::warn("Unknown command flag in batch frame: 0x{:x}", flag);
+                return false;
+            }
+        }
 
         return true;
     }
 
+    inline bool readVarint(uint64_t& v) {
+        v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read(&byte, sizeof(byte))) return false;
+
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+
+        spdlog::warn("Malformed varint in batch frame");
+        return false;
+    }
+
+    inline bool readPayload(std::string& data) {
+        uint64_t length;
+        if (!readVarint(length)) return false;
+
+        if (length > UINT32_MAX) {
+            spdlog::warn("Payload too large in batch frame: {}", length);
+            return false;
+        }
+
+        data = payload(static_cast<uint32_t>(length));
+        return read(&data[0], data.size());
+    }
+
     inline bool receiveSignUpResponse(uint16_t cmdId) {
         uint64_t clientId;
         if (!read(&clientId, sizeof(clientId))) return false;
@@ -176,15 +381,48 @@ class Receiver {
         return true;
     }
 
-    asio::ip::tcp::socket& mSocket;
+    // Echoes the timestamp of our heartbeat, see Sender::encode()
+    inline bool receiveHeartbeatAck() {
+        uint64_t time;
+        if (!read(&time, sizeof(time))) return false;
+        time = Util::BigEndian(time);
+
+        uint64_t now = Liveness::Now();
+        if (mLiveness && now >= time)
+            mLiveness->sample(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(now - time)));
+
+        return true;
+    }
+
+    Transport& mTransport;
     ThreadSafeQueue<RawRequest>& mRequestTx;
     ThreadSafeQueue<RawResponse>& mResponseTx;
     ThreadSafeQueue<RawSignUpResponse>& mSignUpResponseTx;
     ThreadSafeQueue<RawSignInResponse>& mSignInResponseTx;
 
-    std::array<char, 1024> mBuf;
+    CaptureWriter* mCapture;
+    Tracer* mTracer;
+
+    AdmissionOptions mAdmission;
+    // Where busy responses go, admission control is off without it
+    ThreadSafeQueue<RawResponse>* mBusyResponseTx;
+    std::atomic<std::size_t> mShedRequests{0};
+
+    ThreadOptions mThreadOptions;
+    Backoff mBackoff{std::chrono::microseconds(0)};
+
+    Liveness* mLiveness;
+    std::function<bool(uint16_t)> mHandles;
+
+    // Raw bytes of the current frame, only filled when capturing
+    std::vector<char> mFrame;
+
+    std::vector<char> mRxBuf = std::vector<char>(64 << 10);
+    std::size_t mRxBegin = 0;
+    std::size_t mRxEnd = 0;
 
     std::atomic_bool mStopFlag;
+    std::atomic_bool mRunning{false};
 
     std::thread mHandle;
 };
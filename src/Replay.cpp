@@ -0,0 +1,309 @@
+#include <Protocon/Replay.h>
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <asio/ip/tcp.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <asio/local/stream_protocol.hpp>
+#endif
+
+#include "BatchFrame.h"
+#include "Capture.h"
+#include "Socket.h"
+#include "Transport.h"
+#include "Util.h"
+
+#ifdef __linux__
+#include "ShmTransport.h"
+#endif
+
+namespace Protocon {
+
+// Server side of a transport, hands out one connected gateway per accept()
+class Listener {
+  public:
+    virtual ~Listener() {}
+
+    // Returns nullptr on failure or once close() has been called
+    virtual std::unique_ptr<Transport> accept() = 0;
+    // Wakes up an accept() blocked in another thread
+    virtual void close() = 0;
+};
+
+template <typename Protocol, typename Transport_>
+class AsioListener : public Listener {
+  public:
+    AsioListener(const typename Protocol::endpoint& endpoint)
+        : mAcceptor(mContext, endpoint), mWakeEndpoint(Reachable(mAcceptor.local_endpoint())) {}
+
+    std::unique_ptr<Transport> accept() override {
+        auto transport = std::make_unique<Transport_>();
+        try {
+            mAcceptor.accept(transport->socket());
+        } catch (std::exception& e) {
+            spdlog::warn("Failed to accept gateway for replay, details: {}", e.what());
+            return nullptr;
+        }
+
+        if (mClosed) return nullptr;
+        return std::move(transport);
+    }
+
+    // A blocking accept() only returns for a connection, so close() makes one
+    void close() override {
+        mClosed = true;
+
+        asio::io_context context;
+        typename Protocol::socket waker(context);
+        asio::error_code ec;
+        waker.connect(mWakeEndpoint, ec);
+    }
+
+  private:
+    static asio::ip::tcp::endpoint Reachable(asio::ip::tcp::endpoint endpoint) {
+        if (endpoint.address().is_unspecified()) endpoint.address(asio::ip::address_v4::loopback());
+        return endpoint;
+    }
+    template <typename Endpoint>
+    static Endpoint Reachable(const Endpoint& endpoint) { return endpoint; }
+
+    asio::io_context mContext;
+    typename Protocol::acceptor mAcceptor;
+    typename Protocol::endpoint mWakeEndpoint;
+    std::atomic<bool> mClosed{false};
+};
+
+#ifdef __linux__
+
+class ShmListener : public Listener {
+  public:
+    bool listen(const std::string& name) { return mTransport->listen(name); }
+
+    std::unique_ptr<Transport> accept() override {
+        ShmTransport* transport;
+        {
+            std::lock_guard<std::mutex> lock(mMtx);
+            if (!mTransport || mClosed) return nullptr;
+            transport = mTransport.get();
+        }
+
+        bool accepted = transport->accept();
+
+        // Once handed out, close() must not touch the transport any more
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (!accepted || mClosed) return nullptr;
+        return std::move(mTransport);
+    }
+
+    void close() override {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mClosed = true;
+        if (mTransport) mTransport->cancelAccept();
+    }
+
+  private:
+    std::mutex mMtx;
+    std::unique_ptr<ShmTransport> mTransport = std::make_unique<ShmTransport>();
+    bool mClosed = false;
+};
+
+#endif
+
+// Packs consecutive captured requests and responses into batch frames
+class BatchEncoder {
+  public:
+    // Keeps the frames about the size of a socket buffer write
+    static constexpr std::size_t MaxCommands = 256;
+
+    // False if the frame can't join the pending batch, which then has to be
+    // flushed first. Frames other than requests and responses never join,
+    // and neither do frames with another time than the batch.
+    bool add(const char* frame, std::size_t length) {
+        if (mCount == MaxCommands) return false;
+
+        if (frame[0] == 0x00 && length >= RequestHeader) {
+            uint64_t gatewayId = get<uint64_t>(frame + 3);
+            uint16_t apiVersion = get<uint16_t>(frame + 27);
+            if (mRequests && (gatewayId != mGatewayId || apiVersion != mApiVersion)) return false;
+            if (!begin(get<uint64_t>(frame + 19))) return false;
+
+            BatchFrame::PutRequest(mBuf, get<uint16_t>(frame + 1), get<uint64_t>(frame + 11), get<uint16_t>(frame + 29),
+                                   frame + RequestHeader, length - RequestHeader);
+            mGatewayId = gatewayId;
+            mApiVersion = apiVersion;
+            mRequests++;
+        } else if (static_cast<uint8_t>(frame[0]) == 0x80 && length >= ResponseHeader) {
+            if (!begin(get<uint64_t>(frame + 3))) return false;
+            BatchFrame::PutResponse(mBuf, get<uint16_t>(frame + 1), static_cast<uint8_t>(frame[11]),
+                                    frame + ResponseHeader, length - ResponseHeader);
+        } else {
+            return false;
+        }
+
+        mCount++;
+        return true;
+    }
+
+    bool empty() const { return !mCount; }
+
+    // Writes the pending batch, a lone frame goes out as a batch of one
+    bool flush(Transport& transport) {
+        if (!mCount) return true;
+
+        BatchFrame::End(mBuf, 0, static_cast<uint16_t>(mCount), mGatewayId, mApiVersion, mTime);
+        bool written = transport.write(mBuf.data(), mBuf.size(), false);
+
+        mBuf.clear();
+        mCount = 0;
+        mRequests = 0;
+        mGatewayId = 0;
+        mApiVersion = 0;
+        return written;
+    }
+
+  private:
+    static constexpr std::size_t RequestHeader = 35;
+    static constexpr std::size_t ResponseHeader = 16;
+
+    template <typename T>
+    static T get(const char* p) {
+        T v;
+        std::memcpy(&v, p, sizeof(v));
+        return Util::BigEndian(v);
+    }
+
+    // The batch takes the time of its first command
+    bool begin(uint64_t time) {
+        if (mCount) return time == mTime;
+
+        BatchFrame::Begin(mBuf);
+        mTime = time;
+        return true;
+    }
+
+    std::vector<char> mBuf;
+    std::size_t mCount = 0;
+    std::size_t mRequests = 0;
+    uint64_t mGatewayId = 0;
+    uint16_t mApiVersion = 0;
+    uint64_t mTime = 0;
+};
+
+Replay::Replay(std::string path) : mPath(std::move(path)) {}
+
+Replay::~Replay() {}
+
+bool Replay::listen(uint16_t port) {
+    try {
+        mListener = std::make_unique<AsioListener<asio::ip::tcp, Socket>>(asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port));
+    } catch (std::exception& e) {
+        spdlog::warn("Failed to listen for replay, details: {}", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+bool Replay::listenUnix(const std::string& path) {
+#ifndef _WIN32
+    // A socket file left over by a previous run would fail the bind
+    std::remove(path.c_str());
+
+    try {
+        mListener = std::make_unique<AsioListener<asio::local::stream_protocol, UnixSocket>>(asio::local::stream_protocol::endpoint(path));
+    } catch (std::exception& e) {
+        spdlog::warn("Failed to listen for replay, details: {}", e.what());
+        return false;
+    }
+
+    return true;
+#else
+    spdlog::warn("Unix domain sockets are not supported on this platform");
+    return false;
+#endif
+}
+
+bool Replay::listenSharedMemory(const std::string& name) {
+#ifdef __linux__
+    auto listener = std::make_unique<ShmListener>();
+    if (!listener->listen(name)) return false;
+
+    mListener = std::move(listener);
+    return true;
+#else
+    spdlog::warn("Shared memory transport is not supported on this platform");
+    return false;
+#endif
+}
+
+void Replay::close() {
+    if (mListener) mListener->close();
+}
+
+std::size_t Replay::serve(bool realtime, bool batch) {
+    CaptureReader reader;
+    if (!mListener || !reader.open(mPath)) return 0;
+
+    std::unique_ptr<Transport> transport = mListener->accept();
+    if (!transport) return 0;
+
+    // Whatever the gateway sends back is discarded, but it has to be read,
+    // otherwise closing the socket would reset the connection
+    std::thread drain([&transport] {
+        std::array<char, 4096> buf;
+        while (transport->read(buf.data(), buf.size()))
+            ;
+    });
+
+    std::size_t frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t firstTime = 0;
+
+    // Pacing leaves nothing queued to batch
+    batch = batch && !realtime;
+    BatchEncoder encoder;
+
+    CaptureReader::Record r;
+    while (reader.next(r)) {
+        if (r.direction != Capture::Inbound) continue;
+
+        if (batch) {
+            if (encoder.add(r.data, r.length)) {
+                frames++;
+                continue;
+            }
+
+            if (!encoder.flush(*transport)) break;
+            if (encoder.add(r.data, r.length)) {
+                frames++;
+                continue;
+            }
+        }
+
+        if (realtime) {
+            if (!frames) firstTime = r.time;
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(r.time - firstTime));
+        }
+
+        if (!transport->write(r.data, r.length, false)) break;
+        frames++;
+    }
+
+    if (batch) encoder.flush(*transport);
+
+    transport->shutdownSend();
+    drain.join();
+
+    return frames;
+}
+
+}  // namespace Protocon
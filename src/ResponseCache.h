@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Protocon/Response.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace Protocon {
+
+// LRU cache of handler responses for a single request type, keyed on the
+// request payload. Entries expire after `ttl` and at most `capacity`
+// entries are kept. Payloads are compared in full on lookup, the hash only
+// narrows the search.
+class ResponseCache {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    ResponseCache(Clock::duration ttl, std::size_t capacity)
+        : mTtl(ttl), mCapacity(capacity) {}
+
+    // Computed once by callers doing a find() and then an insert()
+    static std::size_t Hash(const std::string& data) { return std::hash<std::string>()(data); }
+
+    // Returns nullptr on miss, the pointer is valid until the next modification
+    const Response* find(const std::string& data, Clock::time_point now = Clock::now()) {
+        return find(data, Hash(data), now);
+    }
+
+    const Response* find(const std::string& data, std::size_t hash, Clock::time_point now = Clock::now()) {
+        auto it = lookup(data, hash);
+        if (it == mEntries.end()) return nullptr;
+
+        if (it->expiry <= now) {
+            erase(it);
+            return nullptr;
+        }
+
+        mEntries.splice(mEntries.begin(), mEntries, it);
+        return &it->response;
+    }
+
+    void insert(const std::string& data, const Response& response, Clock::time_point now = Clock::now()) {
+        insert(data, Hash(data), response, now);
+    }
+
+    void insert(const std::string& data, std::size_t hash, const Response& response, Clock::time_point now = Clock::now()) {
+        if (!mCapacity) return;
+
+        auto it = lookup(data, hash);
+        if (it != mEntries.end()) {
+            it->response = response;
+            it->expiry = now + mTtl;
+            mEntries.splice(mEntries.begin(), mEntries, it);
+            return;
+        }
+
+        mEntries.emplace_front(Entry{hash, data, response, now + mTtl});
+        mIndex.emplace(hash, mEntries.begin());
+
+        if (mEntries.size() > mCapacity)
+            erase(std::prev(mEntries.end()));
+    }
+
+    void erase(const std::string& data) {
+        auto it = lookup(data, Hash(data));
+        if (it != mEntries.end()) erase(it);
+    }
+
+    void clear() {
+        mIndex.clear();
+        mEntries.clear();
+    }
+
+    std::size_t size() const { return mEntries.size(); }
+
+  private:
+    struct Entry {
+        std::size_t hash;
+        std::string data;
+        Response response;
+        Clock::time_point expiry;
+    };
+
+    using EntryIt = std::list<Entry>::iterator;
+
+    EntryIt lookup(const std::string& data, std::size_t hash) {
+        auto range = mIndex.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second->data == data) return it->second;
+        return mEntries.end();
+    }
+
+    void erase(EntryIt entryIt) {
+        auto range = mIndex.equal_range(entryIt->hash);
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == entryIt) {
+                mIndex.erase(it);
+                break;
+            }
+        mEntries.erase(entryIt);
+    }
+
+    Clock::duration mTtl;
+    std::size_t mCapacity;
+
+    // Most recently used first
+    std::list<Entry> mEntries;
+    std::unordered_multimap<std::size_t, EntryIt> mIndex;
+};
+
+}  // namespace Protocon
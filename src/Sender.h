@@ -1,54 +1,90 @@
 #pragma once
 
+#include <Protocon/PayloadWriter.h>
+#include <Protocon/ThreadOptions.h>
+#include <Protocon/TransportProfile.h>
 #include <spdlog/spdlog.h>
 
-#include <asio/buffer.hpp>
-#include <asio/ip/tcp.hpp>
-#include <asio/write.hpp>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstring>
 #include <exception>
+#include <memory>
 #include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
+#include "Backoff.h"
+#include "BatchFrame.h"
+#include "Capture.h"
+#include "DeficitRoundRobin.h"
+#include "Liveness.h"
 #include "RawCommand.h"
+#include "SpillQueue.h"
+#include "ThreadPlacement.h"
 #include "ThreadSafeQueue.h"
+#include "Tracer.h"
+#include "Transport.h"
 #include "Util.h"
 
 namespace Protocon {
 
 class Sender {
   public:
-    Sender(asio::ip::tcp::socket& socket,
+    Sender(Transport& transport,
            ThreadSafeQueue<RawRequest>& requestRx,
            ThreadSafeQueue<RawResponse>& responseRx,
            ThreadSafeQueue<RawSignUpRequest>& signUpRequestRx,
-           ThreadSafeQueue<RawSignInRequest>& signInRequestRx)
-        : mSocket(socket),
+           ThreadSafeQueue<RawSignInRequest>& signInRequestRx,
+           const TransportProfile& profile,
+           CaptureWriter* capture = nullptr,
+           Tracer* tracer = nullptr,
+           SpillQueue* spill = nullptr,
+           const ThreadOptions& threadOptions = ThreadOptions(),
+           ThreadSafeQueue<RawHeartbeat>* heartbeatRx = nullptr)
+        : mTransport(transport),
           mRequestRx(requestRx),
           mResponseRx(responseRx),
           mSignUpRequestRx(signUpRequestRx),
-          mSignInRequestRx(signInRequestRx) {}
+          mSignInRequestRx(signInRequestRx),
+          mMaxBatchBytes(profile.maxBatchBytes),
+          mBatchDelay(profile.batchDelay),
+          mIdleInterval(profile.idleInterval),
+          mCapture(capture),
+          mTracer(tracer),
+          mSpill(spill),
+          mThreadOptions(threadOptions),
+          mBackoff(profile.idleInterval),
+          mHeartbeatRx(heartbeatRx),
+          mBatchFrames(profile.batchFrames) {}
 
     void run() {
         mStopFlag = false;
 
         mHandle = std::thread([this]() {
-            while (mSocket.is_open() && !mStopFlag) {
-                if (!mRequestRx.empty())
-                    if (!send(mRequestRx.pop())) break;
-
-                if (!mResponseRx.empty())
-                    if (!send(mResponseRx.pop())) break;
-
-                if (!mSignUpRequestRx.empty())
-                    if (!send(mSignUpRequestRx.pop())) break;
-
-                if (!mSignInRequestRx.empty())
-                    if (!send(mSignInRequestRx.pop())) break;
-
-                std::this_thread::sleep_for(std::chrono::milliseconds(400));
+            ThreadPlacement::Apply(mThreadOptions);
+
+            while (mTransport.is_open() && !mStopFlag) {
+                // Queued frames are encoded back to back and written at once
+                while (batchOpen() && encodeNext())
+                    ;
+
+                if (mTxBuf.empty() && !mDirect) {
+                    idle();
+                    continue;
+                }
+                mBackoff.reset();
+
+                // Give a partial batch a moment to fill up
+                if (mBatchDelay.count() && batchOpen()) {
+                    std::this_thread::sleep_for(mBatchDelay);
+                    while (batchOpen() && encodeNext())
+                        ;
+                }
+
+                if (!flush()) break;
             }
 
             if (mStopFlag)
@@ -63,120 +99,418 @@ class Sender {
         mHandle.join();
     }
 
+    // After stop(), hands back the requests taken off the queue but not
+    // encoded yet, oldest first for each client. Frames that were being
+    // written when the connection went down are lost like any data in flight.
+    template <typename F>
+    void drainUnsent(F&& f) {
+        mRequestLane.drain(std::forward<F>(f));
+    }
+
   private:
-    inline bool write(const void* buf, size_t n) {
-        std::size_t len;
-        try {
-            len = asio::write(mSocket, asio::buffer(buf, n));
-        } catch (std::exception& e) {
-            spdlog::warn("Writer error occurs, details: {}", e.what());
-            return false;
+    // Credit given to each client per round in the request lane
+    static constexpr std::size_t RequestQuantum = 4096;
+    // Smaller PayloadWriter payloads are cheaper to copy into the batch than
+    // to write on their own
+    static constexpr std::size_t DirectWriteThreshold = 16 << 10;
+    // Spilled requests read into the request lane at a time
+    static constexpr std::size_t SpillBatch = 64;
+
+    static std::size_t frameSize(const RawRequest& r) {
+        return sizeof(uint8_t) + sizeof(uint16_t) + 3 * sizeof(uint64_t) +
+               2 * sizeof(uint16_t) + sizeof(uint32_t) + payloadLength(writerOf(r), r.request.data);
+    }
+
+    static std::size_t payloadLength(const PayloadWriter* payload, const std::string& data) {
+        return payload ? payload->size() : data.length();
+    }
+
+    static spdlog::string_view_t payloadView(const PayloadWriter* payload, const std::string& data) {
+        return payload ? spdlog::string_view_t(payload->data(), payload->size()) : spdlog::string_view_t(data);
+    }
+
+    // Payload of a frame built with a PayloadWriter, nullptr otherwise
+    static const PayloadWriter* writerOf(const RawRequest& r) {
+        if (r.sharedPayload) return r.sharedPayload.get();
+        return r.payload.mFrame.empty() ? nullptr : &r.payload;
+    }
+    static const PayloadWriter* writerOf(const RawResponse& r) { return r.payload.mFrame.empty() ? nullptr : &r.payload; }
+    template <typename T>
+    static const PayloadWriter* writerOf(const T&) { return nullptr; }
+
+    // Takes over the payload of a frame to write it in place. A broadcast
+    // keeps sharing its own, the header room is rewritten for every client.
+    static std::shared_ptr<PayloadWriter> directOf(RawRequest& r) {
+        if (r.sharedPayload) return r.sharedPayload;
+        return std::make_shared<PayloadWriter>(std::move(r.payload));
+    }
+    static std::shared_ptr<PayloadWriter> directOf(RawResponse& r) { return std::make_shared<PayloadWriter>(std::move(r.payload)); }
+    template <typename T>
+    static std::shared_ptr<PayloadWriter> directOf(T&) { return nullptr; }
+
+    // Busy polling backs off up to the idle interval instead of sleeping it
+    void idle() {
+        if (mThreadOptions.busyPoll)
+            mBackoff.idle();
+        else
+            std::this_thread::sleep_for(mIdleInterval);
+    }
+
+    bool batchOpen() const { return mTxBuf.size() < mMaxBatchBytes && !mDirect; }
+
+    // Writes the batch, then the direct frame behind it if there is one
+    bool flush() {
+        const bool direct = static_cast<bool>(mDirect);
+
+        // Only hint at more data when some is on its way, a corked tail
+        // would otherwise sit in the kernel until the cork timeout
+        if (!mTxBuf.empty()) {
+            if (!mTransport.write(mTxBuf.data(), mTxBuf.size(), direct || queued())) return false;
+            mTxBuf.clear();
         }
-        return len;
+
+        if (direct) {
+            if (!mTransport.write(mDirect->mFrame.data() + mDirectBegin, mDirect->mFrame.size() - mDirectBegin, false)) return false;
+            // Back to the pool, unless other frames share it
+            mDirect.reset();
+        }
+
+        if (mTracer) {
+            for (uint32_t key : mTracedKeys)
+                mTracer->record(Tracer::Sender, key, TraceStage::Write);
+            mTracedKeys.clear();
+        }
+
+        return true;
     }
 
-    inline bool send(const RawRequest& rawRequest) {
-        spdlog::info("Send request, type: 0x{:x}, data: {}", rawRequest.request.type, rawRequest.request.data);
+    // Whether any frame is waiting to be encoded
+    bool queued() {
+        return (mHeartbeatRx && !mHeartbeatRx->empty()) || !mSignUpRequestRx.empty() || !mSignInRequestRx.empty() ||
+               !mResponseRx.empty() || !mRequestRx.empty() || !mRequestLane.empty() || (mSpill && mSpill->size());
+    }
 
-        const Request& r = rawRequest.request;
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Encodes the next frame into mTxBuf, returns false if all lanes are empty.
+    // Lanes are strictly prioritized: control frames first, then responses to
+    // the server, then requests, so a higher lane never waits for a backlog.
+    inline bool encodeNext() {
+        // Ahead of everything else, so that RTT samples don't include time
+        // spent behind a backlog
+        if (mHeartbeatRx && !mHeartbeatRx->empty()) {
+            encodeFrame(mHeartbeatRx->pop());
+            return true;
+        }
+
+        if (!mSignUpRequestRx.empty()) {
+            encodeFrame(mSignUpRequestRx.pop());
+            return true;
+        }
+
+        if (!mSignInRequestRx.empty()) {
+            encodeFrame(mSignInRequestRx.pop());
+            return true;
+        }
+
+        if (mBatchFrames) return encodeBatch();
+
+        if (!mResponseRx.empty()) {
+            encodeFrame(mResponseRx.pop());
+            return true;
+        }
 
-        uint8_t cmdFlag = 0x00;
-        if (!write(&cmdFlag, sizeof(cmdFlag))) return false;
+        fillRequestLane();
 
-        uint16_t cmdId = Util::BigEndian(rawRequest.cmdId);
-        if (!write(&cmdId, sizeof(cmdId))) return false;
+        if (!mRequestLane.empty()) {
+            encodeFrame(mRequestLane.pop());
+            return true;
+        }
 
-        uint64_t gatewayId = Util::BigEndian(rawRequest.gatewayId);
-        if (!write(&gatewayId, sizeof(gatewayId))) return false;
+        return false;
+    }
 
-        uint64_t clientId = Util::BigEndian(rawRequest.clientId);
-        if (!write(&clientId, sizeof(clientId))) return false;
+    // Requests are fair-queued per client by frame bytes
+    inline void fillRequestLane() {
+        while (!mRequestRx.empty()) {
+            RawRequest r = mRequestRx.pop();
+            uint64_t clientId = r.clientId;
+            std::size_t cost = frameSize(r);
+            mRequestLane.push(clientId, std::move(r), cost);
+        }
 
-        uint64_t time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        time = Util::BigEndian(time);
-        if (!write(&time, sizeof(time))) return false;
+        // The spill only drains once the in-memory backlog is gone
+        if (mSpill && mRequestLane.empty()) {
+            RawRequest r;
+            for (std::size_t i = 0; i < SpillBatch && mSpill->pop(r); i++) {
+                uint64_t clientId = r.clientId;
+                std::size_t cost = frameSize(r);
+                mRequestLane.push(clientId, std::move(r), cost);
+            }
+        }
+    }
 
-        uint16_t apiVersion = Util::BigEndian(rawRequest.apiVersion);
-        if (!write(&apiVersion, sizeof(apiVersion))) return false;
+    // Same lane order as encodeNext(), but responses and requests queued
+    // together are packed into one batch frame
+    inline bool encodeBatch() {
+        fillRequestLane();
 
-        uint16_t type = Util::BigEndian(r.type);
-        if (!write(&type, sizeof(type))) return false;
+        if (!mResponseRx.empty()) return startBatch(mResponseRx.pop());
+        if (!mRequestLane.empty()) return startBatch(mRequestLane.pop());
+        return false;
+    }
 
-        uint32_t length = static_cast<uint32_t>(r.data.length());
-        length = Util::BigEndian(length);
-        if (!write(&length, sizeof(length))) return false;
-        length = Util::BigEndian(length);
+    template <typename T>
+    inline bool startBatch(T&& r) {
+        // Nothing to share the frame with
+        if (mResponseRx.empty() && mRequestLane.empty()) {
+            encodeFrame(std::move(r));
+            return true;
+        }
 
-        if (!write(r.data.data(), length)) return false;
+        mBatchBegin = BatchFrame::Begin(mTxBuf);
+        mBatchCount = 0;
+        mBatchRequests = 0;
+        mBatchGatewayId = 0;
+        mBatchApiVersion = 0;
+        mBatchTime = timeOf(r);
+
+        if (!addToBatch(std::move(r))) return true;
+
+        while (mBatchCount < BatchFrame::MaxCommands && mTxBuf.size() < mMaxBatchBytes) {
+            if (!mResponseRx.empty()) {
+                if (!addToBatch(mResponseRx.pop())) return true;
+            } else if (!mRequestLane.empty()) {
+                if (!addToBatch(mRequestLane.pop())) return true;
+            } else {
+                break;
+            }
+        }
 
+        endBatch();
         return true;
     }
 
-    inline bool send(const RawResponse& rawResponse) {
-        spdlog::info("Send reponse, data: {}", rawResponse.response.data);
+    // A frame that can't join closes the batch and is encoded on its own
+    // right behind it
+    template <typename T>
+    inline bool addToBatch(T&& r) {
+        if (!joinsBatch(r)) {
+            endBatch();
+            encodeFrame(std::move(r));
+            return false;
+        }
 
-        Response r = rawResponse.response;
+        putCommand(r);
+        mBatchCount++;
+        if (mTracer) trace(r);
+        return true;
+    }
 
-        uint8_t cmdFlag = 0x80;
-        if (!write(&cmdFlag, sizeof(cmdFlag))) return false;
+    inline bool joinsBatch(const RawRequest& r) const {
+        if (isLarge(writerOf(r)) || timeOf(r) != mBatchTime) return false;
+        return mBatchRequests == 0 || (r.gatewayId == mBatchGatewayId && r.apiVersion == mBatchApiVersion);
+    }
 
-        uint16_t cmdId = Util::BigEndian(rawResponse.cmdId);
-        if (!write(&cmdId, sizeof(cmdId))) return false;
+    inline bool joinsBatch(const RawResponse& r) const { return !isLarge(writerOf(r)) && timeOf(r) == mBatchTime; }
 
-        uint64_t time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        if (!write(&time, sizeof(time))) return false;
+    // What goes into the time field: requests are stamped when sent,
+    // responses keep the time they were produced at
+    static uint64_t timeOf(const RawRequest&) { return now(); }
+    static uint64_t timeOf(const RawResponse& r) { return r.response.time ? r.response.time : now(); }
 
-        if (!write(&r.status, sizeof(r.status))) return false;
+    static bool isLarge(const PayloadWriter* payload) { return payload && payload->size() >= DirectWriteThreshold; }
 
-        uint32_t length = static_cast<uint32_t>(r.data.length());
-        length = Util::BigEndian(length);
-        if (!write(&length, sizeof(length))) return false;
-        length = Util::BigEndian(length);
+    inline void putCommand(const RawRequest& rawRequest) {
+        const Request& r = rawRequest.request;
+        const PayloadWriter* payload = writerOf(rawRequest);
 
-        if (!write(r.data.data(), length)) return false;
+        mBatchRequests++;
+        mBatchGatewayId = rawRequest.gatewayId;
+        mBatchApiVersion = rawRequest.apiVersion;
 
-        return true;
+        BatchFrame::PutRequest(mTxBuf, rawRequest.cmdId, rawRequest.clientId, r.type,
+                               payload ? payload->data() : r.data.data(), payloadLength(payload, r.data));
     }
 
-    inline bool send(const RawSignUpRequest& r) {
-        spdlog::info("Send sign up request");
+    inline void putCommand(const RawResponse& rawResponse) {
+        const Response& r = rawResponse.response;
+        const PayloadWriter* payload = writerOf(rawResponse);
 
-        uint8_t cmdFlag = 0x01;
-        if (!write(&cmdFlag, sizeof(cmdFlag))) return false;
+        BatchFrame::PutResponse(mTxBuf, rawResponse.cmdId, r.status,
+                                payload ? payload->data() : r.data.data(), payloadLength(payload, r.data));
+    }
 
-        uint16_t cmdId = Util::BigEndian(r.cmdId);
-        if (!write(&cmdId, sizeof(cmdId))) return false;
+    inline void endBatch() {
+        // Only happens if the very first frame couldn't join
+        if (mBatchCount == 0) {
+            mTxBuf.resize(mBatchBegin);
+            return;
+        }
 
-        uint64_t gatewayId = Util::BigEndian(r.gatewayId);
-        if (!write(&gatewayId, sizeof(gatewayId))) return false;
+        BatchFrame::End(mTxBuf, mBatchBegin, static_cast<uint16_t>(mBatchCount), mBatchGatewayId, mBatchApiVersion, mBatchTime);
 
-        return true;
+        spdlog::info("Send batch, commands: {}, requests: {}", mBatchCount, mBatchRequests);
+
+        if (mCapture)
+            mCapture->append(Capture::Outbound, mTxBuf.data() + mBatchBegin, mTxBuf.size() - mBatchBegin);
     }
 
-    inline bool send(const RawSignInRequest& r) {
-        spdlog::info("Send sign in request, client ID: {}", r.clientId);
+    template <typename T>
+    inline void encodeFrame(T&& r) {
+        std::size_t begin = mTxBuf.size();
+        encode(r);
+
+        const char* frame;
+        std::size_t length;
+        const PayloadWriter* payload = writerOf(r);
+        if (isLarge(payload)) {
+            // The header moves into the room in front of the payload, and the
+            // frame is written straight from the writer's buffer
+            std::size_t headerLength = mTxBuf.size() - begin;
+            mDirect = directOf(r);
+            mDirectBegin = PayloadWriter::HeaderRoom - headerLength;
+            std::memcpy(mDirect->mFrame.data() + mDirectBegin, mTxBuf.data() + begin, headerLength);
+            mTxBuf.resize(begin);
+
+            frame = mDirect->mFrame.data() + mDirectBegin;
+            length = mDirect->mFrame.size() - mDirectBegin;
+        } else {
+            if (payload) put(payload->data(), payload->size());
+
+            frame = mTxBuf.data() + begin;
+            length = mTxBuf.size() - begin;
+        }
 
-        uint8_t cmdFlag = 0x02;
-        if (!write(&cmdFlag, sizeof(cmdFlag))) return false;
+        if (mCapture)
+            mCapture->append(Capture::Outbound, frame, length);
 
-        uint16_t cmdId = Util::BigEndian(r.cmdId);
-        if (!write(&cmdId, sizeof(cmdId))) return false;
+        if (mTracer) trace(r);
+    }
 
-        uint64_t gatewayId = Util::BigEndian(r.gatewayId);
-        if (!write(&gatewayId, sizeof(gatewayId))) return false;
+    // Requests and responses are traced, control frames aren't
+    inline void trace(const RawRequest& r) { traceDequeue(Tracer::Key(Tracer::Outbound, r.cmdId)); }
+    inline void trace(const RawResponse& r) { traceDequeue(Tracer::Key(Tracer::Inbound, r.cmdId)); }
+    template <typename T>
+    inline void trace(const T&) {}
 
-        uint64_t clientId = Util::BigEndian(r.clientId);
-        if (!write(&clientId, sizeof(clientId))) return false;
+    inline void traceDequeue(uint32_t key) {
+        mTracer->record(Tracer::Sender, key, TraceStage::Dequeue);
+        mTracedKeys.push_back(key);
+    }
 
-        return true;
+    inline void put(const void* buf, size_t n) {
+        auto p = static_cast<const char*>(buf);
+        mTxBuf.insert(mTxBuf.end(), p, p + n);
+    }
+
+    template <typename T>
+    inline void put(T v) {
+        put(&v, sizeof(v));
+    }
+
+    // Payloads of PayloadWriter frames are appended by encodeFrame()
+    inline void encode(const RawRequest& rawRequest) {
+        const Request& r = rawRequest.request;
+
+        const PayloadWriter* payload = writerOf(rawRequest);
+
+        spdlog::info("Send request, type: 0x{:x}, data: {}", r.type, payloadView(payload, r.data));
+
+        put(uint8_t(0x00));
+        put(Util::BigEndian(rawRequest.cmdId));
+        put(Util::BigEndian(rawRequest.gatewayId));
+        put(Util::BigEndian(rawRequest.clientId));
+        put(Util::BigEndian(timeOf(rawRequest)));
+        put(Util::BigEndian(rawRequest.apiVersion));
+        put(Util::BigEndian(r.type));
+        put(Util::BigEndian(static_cast<uint32_t>(payloadLength(payload, r.data))));
+        if (!payload) put(r.data.data(), r.data.length());
+    }
+
+    inline void encode(const RawResponse& rawResponse) {
+        const Response& r = rawResponse.response;
+
+        const PayloadWriter* payload = writerOf(rawResponse);
+
+        spdlog::info("Send reponse, data: {}", payloadView(payload, r.data));
+
+        put(uint8_t(0x80));
+        put(Util::BigEndian(rawResponse.cmdId));
+        put(Util::BigEndian(timeOf(rawResponse)));
+        put(r.status);
+        put(Util::BigEndian(static_cast<uint32_t>(payloadLength(payload, r.data))));
+        if (!payload) put(r.data.data(), r.data.length());
+    }
+
+    inline void encode(const RawSignUpRequest& r) {
+        spdlog::info("Send sign up request");
+
+        put(uint8_t(0x01));
+        put(Util::BigEndian(r.cmdId));
+        put(Util::BigEndian(r.gatewayId));
+    }
+
+    inline void encode(const RawSignInRequest& r) {
+        spdlog::info("Send sign in request, client ID: {}", r.clientId);
+
+        put(uint8_t(0x02));
+        put(Util::BigEndian(r.cmdId));
+        put(Util::BigEndian(r.gatewayId));
+        put(Util::BigEndian(r.clientId));
     }
 
-    asio::ip::tcp::socket& mSocket;
+    inline void encode(const RawHeartbeat& r) {
+        put(uint8_t(0x03));
+        put(Util::BigEndian(r.cmdId));
+        put(Util::BigEndian(r.gatewayId));
+        put(Util::BigEndian(Liveness::Now()));
+    }
+
+    Transport& mTransport;
     ThreadSafeQueue<RawRequest>& mRequestRx;
     ThreadSafeQueue<RawResponse>& mResponseRx;
     ThreadSafeQueue<RawSignUpRequest>& mSignUpRequestRx;
     ThreadSafeQueue<RawSignInRequest>& mSignInRequestRx;
 
+    DeficitRoundRobin<uint64_t, RawRequest> mRequestLane{RequestQuantum};
+
+    std::size_t mMaxBatchBytes;
+    std::chrono::microseconds mBatchDelay;
+    std::chrono::microseconds mIdleInterval;
+
+    CaptureWriter* mCapture;
+
+    Tracer* mTracer;
+
+    SpillQueue* mSpill;
+
+    ThreadOptions mThreadOptions;
+    Backoff mBackoff;
+
+    ThreadSafeQueue<RawHeartbeat>* mHeartbeatRx;
+
+    // Whether the server takes batch frames, and the one being encoded
+    bool mBatchFrames;
+    std::size_t mBatchBegin = 0;
+    std::size_t mBatchCount = 0;
+    std::size_t mBatchRequests = 0;
+    uint64_t mBatchGatewayId = 0;
+    uint16_t mBatchApiVersion = 0;
+    uint64_t mBatchTime = 0;
+
+    // Traced frames in mTxBuf
+    std::vector<uint32_t> mTracedKeys;
+
+    // Frames encoded but not written yet
+    std::vector<char> mTxBuf;
+    // A large PayloadWriter frame to be written after mTxBuf, starting at
+    // mDirectBegin
+    std::shared_ptr<PayloadWriter> mDirect;
+    std::size_t mDirectBegin = 0;
+
     std::atomic_bool mStopFlag;
 
     std::thread mHandle;
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "Transport.h"
+
+namespace Protocon {
+
+// Single producer, single consumer byte ring placed in shared memory. The
+// sequence counters double as futex words, so a side only sleeps in the
+// kernel when the ring is empty (reader) or full (writer).
+struct ShmRing {
+    alignas(64) uint64_t head;
+    alignas(64) uint64_t tail;
+    alignas(64) uint32_t dataSeq;
+    uint32_t dataWaiters;
+    uint32_t spaceSeq;
+    uint32_t spaceWaiters;
+    uint32_t closed;
+};
+
+// Shared memory segment layout: this header followed by the data of both
+// rings, each `capacity` bytes
+struct ShmSegment {
+    char magic[8];
+    uint32_t capacity;
+    // 1 once a gateway has attached, 2 once the server stopped waiting
+    uint32_t connected;
+    // 0: client to server, 1: server to client
+    ShmRing rings[2];
+};
+
+// Transport over a pair of shared memory rings for a server on the same
+// host. The server creates the segment with listen(), the gateway attaches
+// with connect(), `host` being the segment name (e.g. "/protocon") and the
+// port being ignored. Frames use the same format as over TCP.
+class ShmTransport : public Transport {
+  public:
+    static constexpr std::size_t DefaultCapacity = 1 << 20;
+
+    ShmTransport() {}
+    ShmTransport(const ShmTransport&) = delete;
+    ShmTransport& operator=(const ShmTransport&) = delete;
+
+    ~ShmTransport() override {
+        if (mSegment) ::munmap(mSegment, mSize);
+        if (!mOwnedName.empty()) ::shm_unlink(mOwnedName.c_str());
+    }
+
+    bool is_open() const override { return mSegment && !mShutdown; }
+
+    bool connect(const char* host, uint16_t port) override {
+        int fd = ::shm_open(host, O_RDWR, 0);
+        if (fd < 0) {
+            spdlog::warn("Failed to connect to server, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) || static_cast<std::size_t>(st.st_size) < sizeof(ShmSegment) || !map(fd, st.st_size)) {
+            spdlog::warn("Failed to connect to server, invalid shared memory segment {}", host);
+            ::close(fd);
+            return false;
+        }
+        ::close(fd);
+
+        if (std::memcmp(mSegment->magic, Magic(), sizeof(mSegment->magic)) ||
+            sizeof(ShmSegment) + 2 * static_cast<std::size_t>(mSegment->capacity) > mSize) {
+            spdlog::warn("Failed to connect to server, invalid shared memory segment {}", host);
+            ::munmap(mSegment, mSize);
+            mSegment = nullptr;
+            return false;
+        }
+
+        // One gateway per segment, the rings have a single producer and
+        // consumer each
+        uint32_t expected = 0;
+        if (!__atomic_compare_exchange_n(&mSegment->connected, &expected, Attached, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            spdlog::warn("Failed to connect to server, shared memory segment {} is in use", host);
+            ::munmap(mSegment, mSize);
+            mSegment = nullptr;
+            return false;
+        }
+        futexWake(&mSegment->connected);
+
+        attach(0, 1);
+        return true;
+    }
+
+    // Server side: creates the segment, capacity must be a power of two
+    bool listen(const std::string& name, std::size_t capacity = DefaultCapacity) {
+        if (!capacity || (capacity & (capacity - 1))) {
+            spdlog::warn("Shared memory ring capacity must be a power of two");
+            return false;
+        }
+
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            spdlog::warn("Failed to create shared memory segment {}, details: {}", name, std::strerror(errno));
+            return false;
+        }
+        mOwnedName = name;
+
+        std::size_t size = sizeof(ShmSegment) + 2 * capacity;
+        if (::ftruncate(fd, size) || !map(fd, size)) {
+            spdlog::warn("Failed to create shared memory segment {}, details: {}", name, std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        ::close(fd);
+
+        // The magic goes last, a gateway attaching early sees an invalid segment
+        mSegment->capacity = static_cast<uint32_t>(capacity);
+        attach(1, 0);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        std::memcpy(mSegment->magic, Magic(), sizeof(mSegment->magic));
+
+        return true;
+    }
+
+    // Server side: blocks until a gateway has attached, false if
+    // cancelAccept() came first
+    bool accept() {
+        uint32_t connected;
+        while (!(connected = __atomic_load_n(&mSegment->connected, __ATOMIC_SEQ_CST)))
+            futexWait(&mSegment->connected, connected);
+        return connected == Attached;
+    }
+
+    // Wakes up accept() from another thread, unless a gateway got there first
+    void cancelAccept() {
+        uint32_t expected = 0;
+        if (__atomic_compare_exchange_n(&mSegment->connected, &expected, Cancelled, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            futexWake(&mSegment->connected);
+    }
+
+    bool shutdown() override {
+        if (!mSegment) return true;
+
+        mShutdown = true;
+        close(mRx);
+        close(mTx);
+        return true;
+    }
+
+    bool shutdownSend() override {
+        if (mSegment) close(mTx);
+        return true;
+    }
+
+    std::size_t read(void* buf, std::size_t n) override {
+        uint64_t head = __atomic_load_n(&mRx->head, __ATOMIC_RELAXED);
+
+        while (true) {
+            uint64_t tail = __atomic_load_n(&mRx->tail, __ATOMIC_ACQUIRE);
+            if (tail != head) {
+                std::size_t len = std::min<std::size_t>(n, tail - head);
+                copyOut(static_cast<char*>(buf), mRxData, head, len);
+                __atomic_store_n(&mRx->head, head + len, __ATOMIC_RELEASE);
+                signal(&mRx->spaceSeq, &mRx->spaceWaiters);
+                return len;
+            }
+
+            if (__atomic_load_n(&mRx->closed, __ATOMIC_ACQUIRE)) return 0;
+
+            wait(&mRx->dataSeq, &mRx->dataWaiters, [this, head] {
+                return __atomic_load_n(&mRx->tail, __ATOMIC_SEQ_CST) != head ||
+                       __atomic_load_n(&mRx->closed, __ATOMIC_SEQ_CST);
+            });
+        }
+    }
+
+    bool readable() override {
+        return __atomic_load_n(&mRx->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&mRx->head, __ATOMIC_RELAXED) ||
+               __atomic_load_n(&mRx->closed, __ATOMIC_ACQUIRE);
+    }
+
+    bool write(const void* buf, std::size_t n, bool more) override {
+        auto p = static_cast<const char*>(buf);
+        uint64_t tail = __atomic_load_n(&mTx->tail, __ATOMIC_RELAXED);
+
+        while (n) {
+            if (__atomic_load_n(&mTx->closed, __ATOMIC_ACQUIRE)) {
+                spdlog::warn("Writer error occurs, details: shared memory ring closed");
+                return false;
+            }
+
+            uint64_t head = __atomic_load_n(&mTx->head, __ATOMIC_ACQUIRE);
+            std::size_t space = mCapacity - (tail - head);
+            if (!space) {
+                wait(&mTx->spaceSeq, &mTx->spaceWaiters, [this, head] {
+                    return __atomic_load_n(&mTx->head, __ATOMIC_SEQ_CST) != head ||
+                           __atomic_load_n(&mTx->closed, __ATOMIC_SEQ_CST);
+                });
+                continue;
+            }
+
+            std::size_t len = std::min(n, space);
+            copyIn(mTxData, tail, p, len);
+            tail += len;
+            __atomic_store_n(&mTx->tail, tail, __ATOMIC_RELEASE);
+            signal(&mTx->dataSeq, &mTx->dataWaiters);
+
+            p += len;
+            n -= len;
+        }
+
+        return true;
+    }
+
+  private:
+    // Values of ShmSegment::connected besides 0
+    static constexpr uint32_t Attached = 1;
+    static constexpr uint32_t Cancelled = 2;
+
+    static const char* Magic() { return "PRTSHM01"; }
+
+    static void futexWait(uint32_t* addr, uint32_t val) {
+        ::syscall(SYS_futex, addr, FUTEX_WAIT, val, nullptr, nullptr, 0);
+    }
+
+    static void futexWake(uint32_t* addr) {
+        ::syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    // Sleeps until ready() or a signal() on seq, whichever comes first
+    template <typename F>
+    static void wait(uint32_t* seq, uint32_t* waiters, F ready) {
+        uint32_t s = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+        if (!ready()) futexWait(seq, s);
+        __atomic_fetch_sub(waiters, 1, __ATOMIC_SEQ_CST);
+    }
+
+    static void signal(uint32_t* seq, uint32_t* waiters) {
+        __atomic_fetch_add(seq, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST)) futexWake(seq);
+    }
+
+    static void close(ShmRing* ring) {
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+        signal(&ring->dataSeq, &ring->dataWaiters);
+        signal(&ring->spaceSeq, &ring->spaceWaiters);
+    }
+
+    bool map(int fd, std::size_t size) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+
+        mSegment = static_cast<ShmSegment*>(p);
+        mSize = size;
+        return true;
+    }
+
+    void attach(int tx, int rx) {
+        mCapacity = mSegment->capacity;
+        char* data = reinterpret_cast<char*>(mSegment + 1);
+        mTx = &mSegment->rings[tx];
+        mTxData = data + tx * mCapacity;
+        mRx = &mSegment->rings[rx];
+        mRxData = data + rx * mCapacity;
+    }
+
+    void copyIn(char* ring, uint64_t pos, const char* p, std::size_t len) {
+        std::size_t offset = pos & (mCapacity - 1);
+        std::size_t first = std::min(len, mCapacity - offset);
+        std::memcpy(ring + offset, p, first);
+        std::memcpy(ring, p + first, len - first);
+    }
+
+    void copyOut(char* p, const char* ring, uint64_t pos, std::size_t len) {
+        std::size_t offset = pos & (mCapacity - 1);
+        std::size_t first = std::min(len, mCapacity - offset);
+        std::memcpy(p, ring + offset, first);
+        std::memcpy(p + first, ring, len - first);
+    }
+
+    ShmSegment* mSegment = nullptr;
+    std::size_t mSize = 0;
+    // Set on the server side, which removes the segment name again
+    std::string mOwnedName;
+    std::atomic<bool> mShutdown{false};
+
+    std::size_t mCapacity = 0;
+    // Owned by the Sender thread
+    ShmRing* mTx = nullptr;
+    char* mTxData = nullptr;
+    // Owned by the Receiver thread
+    ShmRing* mRx = nullptr;
+    char* mRxData = nullptr;
+};
+
+}  // namespace Protocon
@@ -1,39 +1,57 @@
 #pragma once
 
+#include <Protocon/TransportProfile.h>
 #include <spdlog/spdlog.h>
 
+#include <asio/buffer.hpp>
 #include <asio/connect.hpp>
 #include <asio/ip/address.hpp>
 #include <asio/ip/address_v4.hpp>
 #include <asio/ip/tcp.hpp>
+#include <asio/write.hpp>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <exception>
 
+#ifndef _WIN32
+#include <asio/local/stream_protocol.hpp>
+#endif
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+#include "Connector.h"
+#include "Transport.h"
+
 namespace Protocon {
 
-class Socket {
+// Blocking stream transport on top of asio, connect() is up to the protocol
+template <typename Protocol>
+class BasicSocket : public Transport {
   public:
-    Socket() : mSocket(mContext) {}
+    explicit BasicSocket(const TransportProfile& profile)
+        : mProfile(profile), mSocket(mContext) {}
 
-    // TODO: We shouldn't expose it directly
-    asio::ip::tcp::socket& socket() { return mSocket; };
+    // Used to accept a connection into, on the server side
+    typename Protocol::socket& socket() { return mSocket; }
 
-    bool is_open() const { return mSocket.is_open(); }
+    bool is_open() const override { return mSocket.is_open(); }
 
-    bool connect(const char* host, uint16_t port) {
+    bool shutdown() override {
         try {
-            mSocket.connect(asio::ip::tcp::endpoint(asio::ip::make_address(host), port));
+            mSocket.shutdown(asio::socket_base::shutdown_both);
         } catch (std::exception& e) {
-            spdlog::warn("Failed to connect to server, details: {}", e.what());
-            return false;
+            spdlog::warn("Failed to shutdown the socket, details: {}", e.what());
         }
 
         return true;
     }
 
-    bool shutdown() {
+    bool shutdownSend() override {
         try {
-            mSocket.shutdown(asio::socket_base::shutdown_both);
+            mSocket.shutdown(asio::socket_base::shutdown_send);
         } catch (std::exception& e) {
             spdlog::warn("Failed to shutdown the socket, details: {}", e.what());
         }
@@ -41,9 +59,127 @@ class Socket {
         return true;
     }
 
-  private:
+    std::size_t read(void* buf, std::size_t n) override {
+        try {
+            return mSocket.read_some(asio::buffer(buf, n));
+        } catch (std::exception& e) {
+            spdlog::warn("Reader error occurs, details: {}", e.what());
+            return 0;
+        }
+    }
+
+    bool readable() override {
+        asio::error_code ec;
+        return mSocket.available(ec) || ec;
+    }
+
+    bool write(const void* buf, std::size_t n, bool more) override {
+        try {
+#ifdef MSG_MORE
+            if (mProfile.cork) {
+                auto p = static_cast<const char*>(buf);
+                while (n) {
+                    std::size_t len = mSocket.send(asio::buffer(p, n), more ? MSG_MORE : 0);
+                    p += len;
+                    n -= len;
+                }
+                return true;
+            }
+#endif
+            asio::write(mSocket, asio::buffer(buf, n));
+        } catch (std::exception& e) {
+            spdlog::warn("Writer error occurs, details: {}", e.what());
+            return false;
+        }
+
+        return true;
+    }
+
+  protected:
+    template <typename Endpoint>
+    bool connectTo(const Endpoint& endpoint) {
+        try {
+            mSocket.connect(endpoint);
+        } catch (std::exception& e) {
+            spdlog::warn("Failed to connect to server, details: {}", e.what());
+            return false;
+        }
+
+        applyProfile();
+
+        return true;
+    }
+
+    virtual void applyProfile() {
+        // Tuning is best effort, a rejected option only costs performance
+        asio::error_code ec;
+        if (mProfile.sendBufferSize) {
+            mSocket.set_option(asio::socket_base::send_buffer_size(mProfile.sendBufferSize), ec);
+            if (ec) spdlog::warn("Failed to set SO_SNDBUF, details: {}", ec.message());
+        }
+        if (mProfile.receiveBufferSize) {
+            mSocket.set_option(asio::socket_base::receive_buffer_size(mProfile.receiveBufferSize), ec);
+            if (ec) spdlog::warn("Failed to set SO_RCVBUF, details: {}", ec.message());
+        }
+    }
+
+    TransportProfile mProfile;
+
     asio::io_context mContext;
-    asio::ip::tcp::socket mSocket;
+    typename Protocol::socket mSocket;
 };
 
+// TCP, `host` may be a host name or an address
+class Socket : public BasicSocket<asio::ip::tcp> {
+  public:
+    explicit Socket(const TransportProfile& profile = TransportProfile())
+        : BasicSocket(profile) {}
+
+    bool connect(const char* host, uint16_t port) override {
+        return connectAny({Endpoint{host, port}});
+    }
+
+    bool connectAny(const std::vector<Endpoint>& endpoints) override {
+        Connector connector(mContext, mProfile.connectAttemptDelay, mProfile.connectTimeout);
+        if (!connector.connect(endpoints, mSocket)) return false;
+
+        applyProfile();
+
+        return true;
+    }
+
+  private:
+    void applyProfile() override {
+        BasicSocket::applyProfile();
+
+        asio::error_code ec;
+        if (mProfile.noDelay) {
+            mSocket.set_option(asio::ip::tcp::no_delay(true), ec);
+            if (ec) spdlog::warn("Failed to set TCP_NODELAY, details: {}", ec.message());
+        }
+
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+        if (mProfile.busyPollUs &&
+            ::setsockopt(mSocket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &mProfile.busyPollUs, sizeof(mProfile.busyPollUs)))
+            spdlog::warn("Failed to set SO_BUSY_POLL, details: {}", std::strerror(errno));
+#endif
+    }
+};
+
+#ifndef _WIN32
+
+// Unix domain socket for a server on the same host, `host` is the socket
+// path and the port is ignored
+class UnixSocket : public BasicSocket<asio::local::stream_protocol> {
+  public:
+    explicit UnixSocket(const TransportProfile& profile = TransportProfile())
+        : BasicSocket(profile) {}
+
+    bool connect(const char* host, uint16_t port) override {
+        return connectTo(asio::local::stream_protocol::endpoint(host));
+    }
+};
+
+#endif
+
 }  // namespace Protocon
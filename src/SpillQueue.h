@@ -0,0 +1,250 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "RawCommand.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Protocon {
+
+// FIFO of outbound requests on disk, for when they can't be sent or the
+// in-memory queue is full. Records are appended to memory-mapped segment
+// files of a fixed size. Only the segment being written and the one being
+// read are mapped, and a segment file is deleted once it has been drained,
+// so memory use stays bounded however long the backlog gets. The gateway
+// pushes and the Sender pops, both under a mutex.
+//
+// Segment layout, integers in host byte order as files never outlive the
+// process: records of uint32 length, uint16 cmdId, uint64 gatewayId,
+// uint64 clientId, uint16 apiVersion, uint64 time, uint16 type, payload.
+// A length of SegmentEnd, or less than 4 bytes left, ends a segment.
+class SpillQueue {
+  public:
+    static constexpr std::size_t DefaultSegmentSize = 64 << 20;
+
+    SpillQueue(std::string directory, std::size_t segmentSize = DefaultSegmentSize)
+        : mDirectory(std::move(directory)), mSegmentSize(segmentSize) {}
+
+    ~SpillQueue() {
+#ifndef _WIN32
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (mTail.map) unmap(mTail);
+        if (mHead.map) unmap(mHead);
+        for (uint64_t seq = mReadSeq; seq <= mTail.seq && mOpen; seq++)
+            ::unlink(path(seq).c_str());
+#endif
+    }
+
+    // Leftovers of a previous process are discarded
+    bool open() {
+#ifdef _WIN32
+        spdlog::warn("Spilling to disk is not supported on this platform");
+        return false;
+#else
+        if (::mkdir(mDirectory.c_str(), 0755) && errno != EEXIST) {
+            spdlog::warn("Failed to create spill directory {}, details: {}", mDirectory, std::strerror(errno));
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        for (uint64_t seq = 0; !::unlink(path(seq).c_str()); seq++)
+            ;
+
+        if (!create(mTail, 0, mSegmentSize)) return false;
+        mOpen = true;
+        return true;
+#endif
+    }
+
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mCount;
+    }
+
+    bool push(const RawRequest& r) {
+#ifdef _WIN32
+        return false;
+#else
+        const PayloadWriter* payload = r.sharedPayload ? r.sharedPayload.get() : &r.payload;
+        const char* data = payload->size() ? payload->data() : r.request.data.data();
+        const std::size_t dataSize = payload->size() ? payload->size() : r.request.data.size();
+        const std::size_t length = BodySize + dataSize;
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (!mOpen) return false;
+
+        if (mWriteOffset + sizeof(uint32_t) + length > mTail.size) {
+            // Seal the segment, the reader moves on at the marker
+            if (mTail.size - mWriteOffset >= sizeof(uint32_t)) put(mTail.map, mWriteOffset, uint32_t(SegmentEnd));
+
+            Segment next;
+            std::size_t size = sizeof(uint32_t) + length + sizeof(uint32_t);
+            if (!create(next, mTail.seq + 1, size > mSegmentSize ? size : mSegmentSize)) return false;
+            unmap(mTail);
+            mTail = next;
+            mWriteOffset = 0;
+        }
+
+        std::size_t offset = mWriteOffset;
+        put(mTail.map, offset, static_cast<uint32_t>(length));
+        put(mTail.map, offset, r.cmdId);
+        put(mTail.map, offset, r.gatewayId);
+        put(mTail.map, offset, r.clientId);
+        put(mTail.map, offset, r.apiVersion);
+        put(mTail.map, offset, r.request.time);
+        put(mTail.map, offset, r.request.type);
+        std::memcpy(mTail.map + offset, data, dataSize);
+
+        mWriteOffset = offset + dataSize;
+        mCount++;
+        return true;
+#endif
+    }
+
+    bool pop(RawRequest& r) {
+#ifdef _WIN32
+        return false;
+#else
+        std::lock_guard<std::mutex> lock(mMtx);
+        if (!mCount) return false;
+
+        while (true) {
+            if (!mHead.map && !map(mHead, mReadSeq)) return false;
+
+            // The segment being written ends at the write offset
+            const bool sealed = mHead.seq != mTail.seq;
+            const std::size_t end = sealed ? mHead.size : mWriteOffset;
+
+            uint32_t length = SegmentEnd;
+            if (end - mReadOffset >= sizeof(uint32_t)) {
+                std::size_t offset = mReadOffset;
+                get(mHead.map, offset, length);
+            }
+
+            if (length != SegmentEnd && mReadOffset + sizeof(uint32_t) + length <= end) break;
+
+            // Only a sealed segment can run out
+            unmap(mHead);
+            ::unlink(path(mReadSeq).c_str());
+            mReadSeq++;
+            mReadOffset = 0;
+        }
+
+        std::size_t offset = mReadOffset;
+        uint32_t length;
+        get(mHead.map, offset, length);
+        get(mHead.map, offset, r.cmdId);
+        get(mHead.map, offset, r.gatewayId);
+        get(mHead.map, offset, r.clientId);
+        get(mHead.map, offset, r.apiVersion);
+        get(mHead.map, offset, r.request.time);
+        get(mHead.map, offset, r.request.type);
+        r.request.data.assign(mHead.map + offset, length - BodySize);
+        r.payload = PayloadWriter();
+        r.sharedPayload.reset();
+
+        mReadOffset = offset + length - BodySize;
+        mCount--;
+        return true;
+#endif
+    }
+
+  private:
+    static constexpr uint32_t SegmentEnd = 0xffffffff;
+    static constexpr std::size_t BodySize = 3 * sizeof(uint16_t) + 3 * sizeof(uint64_t);
+
+    struct Segment {
+        uint64_t seq = 0;
+        char* map = nullptr;
+        std::size_t size = 0;
+    };
+
+    template <typename T>
+    static void put(char* map, std::size_t& offset, T v) {
+        std::memcpy(map + offset, &v, sizeof(v));
+        offset += sizeof(v);
+    }
+
+    template <typename T>
+    static void get(const char* map, std::size_t& offset, T& v) {
+        std::memcpy(&v, map + offset, sizeof(v));
+        offset += sizeof(v);
+    }
+
+    std::string path(uint64_t seq) const { return mDirectory + "/spill-" + std::to_string(seq) + ".log"; }
+
+#ifndef _WIN32
+    bool create(Segment& segment, uint64_t seq, std::size_t size) {
+        int fd = ::open(path(seq).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0 || ::ftruncate(fd, size)) {
+            spdlog::warn("Failed to create spill segment, details: {}", std::strerror(errno));
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+
+        return mapFd(segment, fd, seq, size);
+    }
+
+    bool map(Segment& segment, uint64_t seq) {
+        int fd = ::open(path(seq).c_str(), O_RDWR);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st)) {
+            spdlog::warn("Failed to open spill segment, details: {}", std::strerror(errno));
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+
+        return mapFd(segment, fd, seq, st.st_size);
+    }
+
+    static bool mapFd(Segment& segment, int fd, uint64_t seq, std::size_t size) {
+        void* map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            spdlog::warn("Failed to map spill segment, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        segment.seq = seq;
+        segment.map = static_cast<char*>(map);
+        segment.size = size;
+        return true;
+    }
+
+    static void unmap(Segment& segment) {
+        ::munmap(segment.map, segment.size);
+        segment.map = nullptr;
+    }
+#endif
+
+    std::string mDirectory;
+    std::size_t mSegmentSize;
+
+    std::mutex mMtx;
+    bool mOpen = false;
+    std::size_t mCount = 0;
+
+    // Written by push()
+    Segment mTail;
+    std::size_t mWriteOffset = 0;
+
+    // Read by pop(), mapped separately even when it is also the tail
+    Segment mHead;
+    uint64_t mReadSeq = 0;
+    std::size_t mReadOffset = 0;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Protocon/ThreadOptions.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Protocon {
+
+class ThreadPlacement {
+  public:
+    // Applies the affinity and name of `options` to the calling thread,
+    // failures are logged and otherwise ignored
+    static void Apply(const ThreadOptions& options) {
+#ifdef __linux__
+        if (!options.name.empty()) {
+            // Longer names are rejected rather than truncated
+            std::string name = options.name.substr(0, 15);
+            if (int err = ::pthread_setname_np(::pthread_self(), name.c_str()))
+                spdlog::warn("Failed to name thread {}, details: {}", name, std::strerror(err));
+        }
+
+        if (options.cpu < 0 && options.numaNode < 0) return;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (options.cpu >= CPU_SETSIZE) {
+            spdlog::warn("CPU {} is out of range, the limit is {}", options.cpu, CPU_SETSIZE);
+            return;
+        } else if (options.cpu >= 0) {
+            CPU_SET(options.cpu, &set);
+        } else if (!NodeCpus(options.numaNode, set)) {
+            spdlog::warn("Failed to read the cores of NUMA node {}", options.numaNode);
+            return;
+        }
+
+        if (int err = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set))
+            spdlog::warn("Failed to set thread affinity, details: {}", std::strerror(err));
+#else
+        if (options.cpu >= 0 || options.numaNode >= 0 || !options.name.empty())
+            spdlog::warn("Thread placement is not supported on this platform");
+#endif
+    }
+
+  private:
+#ifdef __linux__
+    // Parses a cpulist like "0-3,8-11" from sysfs, which saves depending on
+    // libnuma
+    static bool NodeCpus(int node, cpu_set_t& set) {
+        std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        std::FILE* f = std::fopen(path.c_str(), "r");
+        if (!f) return false;
+
+        bool any = false;
+        int first, last;
+        while (std::fscanf(f, "%d", &first) == 1) {
+            last = first;
+            int c = std::fgetc(f);
+            if (c == '-') {
+                if (std::fscanf(f, "%d", &last) != 1) break;
+                c = std::fgetc(f);
+            }
+
+            for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, &set);
+                any = true;
+            }
+
+            if (c != ',') break;
+        }
+
+        std::fclose(f);
+        return any;
+    }
+#endif
+
+    ThreadPlacement() {}
+};
+
+}  // namespace Protocon
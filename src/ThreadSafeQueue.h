@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <mutex>
 #include <queue>
 #include <utility>
@@ -15,6 +16,11 @@ class ThreadSafeQueue {
         return mQueue.empty();
     }
 
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mQueue.size();
+    }
+
     template <typename... Args>
     void emplace(Args&&... args) {
         std::lock_guard<std::mutex> lock(mMtx);
@@ -23,7 +29,7 @@ class ThreadSafeQueue {
 
     T pop() {
         std::lock_guard<std::mutex> lock(mMtx);
-        T v = mQueue.front();
+        T v = std::move(mQueue.front());
         mQueue.pop();
         return v;
     }
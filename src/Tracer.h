@@ -0,0 +1,284 @@
+#pragma once
+
+#include <Protocon/Trace.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Protocon {
+
+enum class TraceStage : uint8_t {
+    // send() queued the request
+    Enqueue,
+    // The Sender encoded the frame
+    Dequeue,
+    // The batch holding the frame was written to the transport
+    Write,
+    // The Receiver decoded the frame
+    Parse,
+    // poll() picked the frame up
+    Dispatch,
+    // The response callback or request handler returned
+    Complete,
+};
+
+struct TraceEvent {
+    uint64_t time;
+    uint32_t key;
+    TraceStage stage;
+};
+
+// Fixed size event log with a single writer thread. Readers may run
+// concurrently and see every event recorded before the size they loaded.
+// Events past the capacity are dropped.
+class TraceBuffer {
+  public:
+    explicit TraceBuffer(std::size_t capacity) : mEvents(capacity) {}
+
+    void record(uint64_t time, uint32_t key, TraceStage stage) {
+        std::size_t n = mSize.load(std::memory_order_relaxed);
+        if (n == mEvents.size()) {
+            mDropped.store(mDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        mEvents[n] = TraceEvent{time, key, stage};
+        mSize.store(n + 1, std::memory_order_release);
+    }
+
+    std::size_t size() const { return mSize.load(std::memory_order_acquire); }
+    std::size_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+    const TraceEvent& operator[](std::size_t i) const { return mEvents[i]; }
+
+  private:
+    std::vector<TraceEvent> mEvents;
+    std::atomic<std::size_t> mSize{0};
+    std::atomic<std::size_t> mDropped{0};
+};
+
+// Nanosecond lifecycle tracing of requests. Every thread touching a request
+// records into its own buffer, events are matched up by direction and
+// command ID when exported.
+//
+//   request (gateway to server): enqueue, dequeue, write, parse, dispatch, complete
+//   server_request (server to gateway): parse, dispatch, complete, dequeue, write
+class Tracer {
+  public:
+    enum Thread {
+        // The thread calling send() and poll()
+        User,
+        Sender,
+        Receiver,
+        ThreadCount,
+    };
+
+    enum Direction : uint32_t {
+        Outbound = 0,
+        Inbound = 1,
+    };
+
+    explicit Tracer(std::size_t capacity) {
+        for (auto& b : mBuffers)
+            b = std::make_unique<TraceBuffer>(capacity);
+    }
+
+    static uint32_t Key(Direction direction, uint16_t cmdId) { return direction << 16 | cmdId; }
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(Thread thread, uint32_t key, TraceStage stage) { record(thread, key, stage, Now()); }
+
+    void record(Thread thread, uint32_t key, TraceStage stage, uint64_t time) {
+        mBuffers[thread]->record(time, key, stage);
+    }
+
+    std::vector<TraceHistogram> histograms() const {
+        std::map<std::string, std::vector<uint64_t>> hops;
+        for (const Span& s : spans()) {
+            const std::string flow = FlowName(s.direction);
+            forEachHop(s, [&](int from, int to) {
+                hops[flow + "/" + StageName(s.direction, from) + "->" + StageName(s.direction, to)].push_back(s.times[to] - s.times[from]);
+            });
+
+            int first = -1, last = -1;
+            for (int i = 0; i < StageCount; i++)
+                if (s.threads[i] >= 0) {
+                    if (first < 0) first = i;
+                    last = i;
+                }
+            if (first != last) hops[flow + "/total"].push_back(s.times[last] - s.times[first]);
+        }
+
+        std::vector<TraceHistogram> histograms;
+        for (auto& it : hops)
+            histograms.push_back(MakeHistogram(it.first, it.second));
+
+        return histograms;
+    }
+
+    // Chrome trace event format, load it in chrome://tracing or Perfetto.
+    // Every hop becomes a slice on the thread which finished it.
+    bool writeChromeTrace(const std::string& path) const {
+        std::FILE* f = std::fopen(path.c_str(), "w");
+        if (!f) {
+            spdlog::warn("Failed to open trace file {}, details: {}", path, std::strerror(errno));
+            return false;
+        }
+
+        std::vector<Span> all = spans();
+        uint64_t origin = UINT64_MAX;
+        for (const Span& s : all)
+            for (int i = 0; i < StageCount; i++)
+                if (s.threads[i] >= 0) origin = std::min(origin, s.times[i]);
+
+        static const char* threadNames[ThreadCount] = {"user", "sender", "receiver"};
+
+        std::fprintf(f, "{\"traceEvents\":[");
+        const char* sep = "\n";
+        for (int t = 0; t < ThreadCount; t++) {
+            std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", sep, t, threadNames[t]);
+            sep = ",\n";
+        }
+
+        for (const Span& s : all)
+            forEachHop(s, [&](int from, int to) {
+                std::fprintf(f, ",\n{\"name\":\"%s->%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"cmdId\":%" PRIu32 "}}",
+                             StageName(s.direction, from), StageName(s.direction, to), FlowName(s.direction),
+                             (s.times[from] - origin) / 1e3, (s.times[to] - s.times[from]) / 1e3, s.threads[to], s.key & 0xffff);
+            });
+
+        std::fprintf(f, "\n]}\n");
+
+        bool ok = !std::ferror(f);
+        if (std::fclose(f) || !ok) {
+            spdlog::warn("Failed to write trace file {}", path);
+            return false;
+        }
+
+        if (std::size_t n = dropped())
+            spdlog::warn("{} trace events were dropped, raise the tracing capacity", n);
+
+        return true;
+    }
+
+    std::size_t dropped() const {
+        std::size_t n = 0;
+        for (const auto& b : mBuffers)
+            n += b->dropped();
+        return n;
+    }
+
+  private:
+    static constexpr int StageCount = 6;
+
+    // One request's pass through the stages, indexed by rank within its flow
+    struct Span {
+        uint32_t key;
+        Direction direction;
+        std::array<uint64_t, StageCount> times;
+        std::array<int, StageCount> threads;
+    };
+
+    struct Event {
+        TraceEvent event;
+        int thread;
+    };
+
+    // Position of a stage within its flow, -1 if the flow never passes it
+    static int Rank(Direction direction, TraceStage stage) {
+        static const int outbound[StageCount] = {0, 1, 2, 3, 4, 5};
+        static const int inbound[StageCount] = {-1, 3, 4, 0, 1, 2};
+        return (direction == Outbound ? outbound : inbound)[static_cast<int>(stage)];
+    }
+
+    static const char* StageName(Direction direction, int rank) {
+        static const char* outbound[StageCount] = {"enqueue", "dequeue", "write", "parse", "dispatch", "complete"};
+        static const char* inbound[StageCount] = {"parse", "dispatch", "complete", "dequeue", "write", ""};
+        return (direction == Outbound ? outbound : inbound)[rank];
+    }
+
+    static const char* FlowName(Direction direction) { return direction == Outbound ? "request" : "server_request"; }
+
+    template <typename F>
+    static void forEachHop(const Span& s, F f) {
+        int prev = -1;
+        for (int i = 0; i < StageCount; i++) {
+            if (s.threads[i] < 0) continue;
+            if (prev >= 0) f(prev, i);
+            prev = i;
+        }
+    }
+
+    static TraceHistogram MakeHistogram(const std::string& hop, std::vector<uint64_t>& v) {
+        std::sort(v.begin(), v.end());
+
+        auto percentile = [&v](double q) { return v[std::min(v.size() - 1, static_cast<std::size_t>(q * v.size()))]; };
+
+        TraceHistogram h{hop, v.size(), v.front(), percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), v.back(), {}};
+        for (uint64_t x : v) {
+            std::size_t bucket = 0;
+            while (x) {
+                bucket++;
+                x >>= 1;
+            }
+            if (h.buckets.size() <= bucket) h.buckets.resize(bucket + 1);
+            h.buckets[bucket]++;
+        }
+
+        return h;
+    }
+
+    // Command IDs wrap around, so a span ends as soon as a stage shows up
+    // which isn't later in the flow than the previous one
+    std::vector<Span> spans() const {
+        std::vector<Event> events;
+        for (int t = 0; t < ThreadCount; t++) {
+            const TraceBuffer& b = *mBuffers[t];
+            for (std::size_t i = 0, n = b.size(); i < n; i++)
+                events.push_back(Event{b[i], t});
+        }
+
+        std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.event.key != b.event.key ? a.event.key < b.event.key : a.event.time < b.event.time;
+        });
+
+        std::vector<Span> spans;
+        int last = StageCount;
+        for (const Event& e : events) {
+            auto direction = static_cast<Direction>(e.event.key >> 16);
+            int rank = Rank(direction, e.event.stage);
+            if (rank < 0) continue;
+
+            if (spans.empty() || spans.back().key != e.event.key || rank <= last) {
+                Span s{e.event.key, direction, {}, {}};
+                s.threads.fill(-1);
+                spans.push_back(s);
+            }
+
+            spans.back().times[rank] = e.event.time;
+            spans.back().threads[rank] = e.thread;
+            last = rank;
+        }
+
+        return spans;
+    }
+
+    std::array<std::unique_ptr<TraceBuffer>, ThreadCount> mBuffers;
+};
+
+}  // namespace Protocon
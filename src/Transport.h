@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Protocon/Endpoint.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Protocon {
+
+// Byte stream to the server, shared by the Receiver and the Sender. read()
+// is only called from the Receiver thread and write() only from the Sender
+// thread, implementations may rely on that.
+class Transport {
+  public:
+    virtual ~Transport() {}
+
+    virtual bool connect(const char* host, uint16_t port) = 0;
+
+    // Connects to any of the endpoints. Falls back to them one after the
+    // other by default, TCP transports race them instead.
+    virtual bool connectAny(const std::vector<Endpoint>& endpoints) {
+        for (const auto& e : endpoints)
+            if (connect(e.host.c_str(), e.port)) return true;
+
+        return false;
+    }
+
+    virtual bool is_open() const = 0;
+
+    // Unblocks pending read() and write() calls
+    virtual bool shutdown() = 0;
+
+    // Half close, the peer reads EOF once it has consumed everything written
+    virtual bool shutdownSend() = 0;
+
+    // Blocks until at least one byte is available, returns 0 on error or EOF
+    virtual std::size_t read(void* buf, std::size_t n) = 0;
+
+    // Whether read() has data to return right away. Busy-polling Receivers
+    // spin on it before they block in read(), so it should be cheap.
+    virtual bool readable() { return true; }
+
+    // Blocks until all n bytes are written. `more` hints that another write
+    // follows right away, corked transports may hold the data back until then.
+    virtual bool write(const void* buf, std::size_t n, bool more) = 0;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <Protocon/TransportProfile.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Connector.h"
+#include "Transport.h"
+
+namespace Protocon {
+
+// Minimal single-threaded io_uring wrapper on top of the raw syscalls
+class Uring {
+  public:
+    Uring() {}
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring() {
+        if (mSqes) ::munmap(mSqes, mSqesSize);
+        if (mCqRing && mCqRing != mSqRing) ::munmap(mCqRing, mCqRingSize);
+        if (mSqRing) ::munmap(mSqRing, mSqRingSize);
+        if (mFd >= 0) ::close(mFd);
+    }
+
+    // With sqpoll, submissions are picked up by a kernel thread instead of a
+    // syscall. attachFd shares that thread with another ring. Falls back to
+    // a regular ring when SQPOLL isn't available.
+    bool init(unsigned entries, bool sqpoll, int attachFd = -1) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        if (sqpoll) {
+            p.flags |= IORING_SETUP_SQPOLL;
+            p.sq_thread_idle = 2000;
+            if (attachFd >= 0) {
+                p.flags |= IORING_SETUP_ATTACH_WQ;
+                p.wq_fd = attachFd;
+            }
+        }
+
+        mFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        if (mFd < 0 && sqpoll) {
+            spdlog::info("SQPOLL unavailable, details: {}", std::strerror(errno));
+            std::memset(&p, 0, sizeof(p));
+            mFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+        }
+        if (mFd < 0) {
+            spdlog::warn("Failed to setup io_uring, details: {}", std::strerror(errno));
+            return false;
+        }
+        mSqPoll = p.flags & IORING_SETUP_SQPOLL;
+
+        mSqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        mCqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+
+        mSqRing = map(mSqRingSize, IORING_OFF_SQ_RING);
+        if (!mSqRing) return false;
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            mCqRing = mSqRing;
+        } else {
+            mCqRing = map(mCqRingSize, IORING_OFF_CQ_RING);
+            if (!mCqRing) return false;
+        }
+
+        mSqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        mSqes = static_cast<io_uring_sqe*>(map(mSqesSize, IORING_OFF_SQES));
+        if (!mSqes) return false;
+
+        char* sq = static_cast<char*>(mSqRing);
+        mSqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        mSqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        mSqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        mSqEntries = p.sq_entries;
+        mSqFlags = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+        mSqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        mSqeTail = *mSqTail;
+
+        char* cq = static_cast<char*>(mCqRing);
+        mCqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        mCqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        mCqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        mCqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        return true;
+    }
+
+    int fd() const { return mFd; }
+
+    int registerResource(unsigned opcode, void* arg, unsigned n) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, mFd, opcode, arg, n));
+    }
+
+    // Returns nullptr when the submission queue is full
+    io_uring_sqe* sqe() {
+        unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        if (mSqeTail - head >= mSqEntries) return nullptr;
+
+        unsigned index = mSqeTail & mSqMask;
+        io_uring_sqe* sqe = &mSqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        mSqArray[index] = index;
+        mSqeTail++;
+
+        return sqe;
+    }
+
+    // Publishes the prepared entries and optionally waits for completions
+    bool submit(unsigned waitNr = 0) {
+        __atomic_store_n(mSqTail, mSqeTail, __ATOMIC_RELEASE);
+
+        unsigned flags = waitNr ? IORING_ENTER_GETEVENTS : 0;
+        unsigned toSubmit = 0;
+        if (mSqPoll) {
+            // Only wake the kernel thread up when it went idle
+            if (__atomic_load_n(mSqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP)
+                flags |= IORING_ENTER_SQ_WAKEUP;
+            if (!flags) return true;
+        } else {
+            toSubmit = mSqeTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+            if (!toSubmit && !waitNr) return true;
+        }
+
+        return enter(toSubmit, waitNr, flags);
+    }
+
+    // Blocks until a completion is available, returns nullptr on error
+    io_uring_cqe* wait() {
+        while (true) {
+            unsigned head = *mCqHead;
+            if (head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE))
+                return &mCqes[head & mCqMask];
+
+            if (!submit(1)) return nullptr;
+        }
+    }
+
+    // Whether a completion is waiting, without entering the kernel
+    bool ready() const {
+        return *mCqHead != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    }
+
+    void seen() {
+        __atomic_store_n(mCqHead, *mCqHead + 1, __ATOMIC_RELEASE);
+    }
+
+  private:
+    void* map(std::size_t size, off_t offset) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, offset);
+        if (p == MAP_FAILED) {
+            spdlog::warn("Failed to map io_uring, details: {}", std::strerror(errno));
+            return nullptr;
+        }
+        return p;
+    }
+
+    bool enter(unsigned toSubmit, unsigned waitNr, unsigned flags) {
+        while (::syscall(__NR_io_uring_enter, mFd, toSubmit, waitNr, flags, nullptr, 0) < 0) {
+            if (errno == EINTR) continue;
+            spdlog::warn("Failed to enter io_uring, details: {}", std::strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    int mFd = -1;
+    bool mSqPoll = false;
+
+    void* mSqRing = nullptr;
+    std::size_t mSqRingSize = 0;
+    void* mCqRing = nullptr;
+    std::size_t mCqRingSize = 0;
+    io_uring_sqe* mSqes = nullptr;
+    std::size_t mSqesSize = 0;
+
+    unsigned* mSqHead = nullptr;
+    unsigned* mSqTail = nullptr;
+    unsigned* mSqFlags = nullptr;
+    unsigned* mSqArray = nullptr;
+    unsigned mSqMask = 0;
+    unsigned mSqEntries = 0;
+    // Entries prepared locally but not published yet
+    unsigned mSqeTail = 0;
+
+    unsigned* mCqHead = nullptr;
+    unsigned* mCqTail = nullptr;
+    unsigned mCqMask = 0;
+    io_uring_cqe* mCqes = nullptr;
+};
+
+// TCP transport on io_uring. Receiving uses a multishot recv into a ring of
+// provided buffers, so one submission keeps delivering data. Sending copies
+// into registered buffers and submits a chain of linked fixed writes with a
+// single syscall, or none at all when the SQPOLL thread is awake.
+class UringTransport : public Transport {
+  public:
+    explicit UringTransport(const TransportProfile& profile = TransportProfile())
+        : mProfile(profile) {}
+
+    ~UringTransport() override {
+        if (mFd >= 0) ::close(mFd);
+        if (mBufRing) ::munmap(mBufRing, mBufRingSize);
+    }
+
+    bool is_open() const override { return mFd >= 0; }
+
+    bool connect(const char* host, uint16_t port) override {
+        return connectAny({Endpoint{host, port}});
+    }
+
+    bool connectAny(const std::vector<Endpoint>& endpoints) override {
+        int fd;
+        {
+            asio::io_context context;
+            asio::ip::tcp::socket socket(context);
+            Connector connector(context, mProfile.connectAttemptDelay, mProfile.connectTimeout);
+            if (!connector.connect(endpoints, socket)) return false;
+
+            // The socket is owned by the rings from here on, in blocking mode
+            fd = ::fcntl(socket.native_handle(), F_DUPFD_CLOEXEC, 0);
+            if (fd < 0 || ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK)) {
+                spdlog::warn("Failed to connect to server, details: {}", std::strerror(errno));
+                if (fd >= 0) ::close(fd);
+                return false;
+            }
+        }
+
+        applyProfile(fd);
+
+        if (!mRecvRing.init(RingEntries, true) ||
+            !mSendRing.init(RingEntries, true, mRecvRing.fd()) ||
+            !setupRecvBuffers() || !setupSendBuffers()) {
+            ::close(fd);
+            return false;
+        }
+
+        mFd = fd;
+        return true;
+    }
+
+    bool shutdown() override {
+        if (mFd >= 0 && ::shutdown(mFd, SHUT_RDWR))
+            spdlog::warn("Failed to shutdown the socket, details: {}", std::strerror(errno));
+
+        return true;
+    }
+
+    bool shutdownSend() override {
+        if (mFd >= 0 && ::shutdown(mFd, SHUT_WR))
+            spdlog::warn("Failed to shutdown the socket, details: {}", std::strerror(errno));
+
+        return true;
+    }
+
+    std::size_t read(void* buf, std::size_t n) override {
+        while (mRecvLen == mRecvOffset) {
+            if (!mRecvArmed && !armRecv()) return 0;
+
+            io_uring_cqe* cqe = mRecvRing.wait();
+            if (!cqe) return 0;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            mRecvRing.seen();
+
+            if (!(flags & IORING_CQE_F_MORE)) mRecvArmed = false;
+
+            if (res > 0) {
+                mRecvBid = flags >> IORING_CQE_BUFFER_SHIFT;
+                mRecvOffset = 0;
+                mRecvLen = res;
+            } else if (res == -ENOBUFS) {
+                // Every buffer was in flight, it is re-armed on the next pass
+            } else if (res == -EINVAL && mMultishot) {
+                // Multishot recv requires Linux 6.0, fall back to one shot
+                mMultishot = false;
+            } else {
+                if (res < 0)
+                    spdlog::warn("Reader error occurs, details: {}", std::strerror(-res));
+                return 0;
+            }
+        }
+
+        std::size_t len = std::min(n, mRecvLen - mRecvOffset);
+        std::memcpy(buf, recvBuffer(mRecvBid) + mRecvOffset, len);
+        mRecvOffset += len;
+
+        if (mRecvOffset == mRecvLen) recycleRecvBuffer(mRecvBid);
+
+        return len;
+    }
+
+    // Polls the completion queue, the recv is armed if it isn't yet
+    bool readable() override {
+        if (mRecvLen != mRecvOffset) return true;
+        if (!mRecvArmed && !armRecv()) return true;
+        return mRecvRing.ready();
+    }
+
+    bool write(const void* buf, std::size_t n, bool more) override {
+        auto p = static_cast<const char*>(buf);
+
+        while (n) {
+            // One linked chain per round, each link in its own registered buffer
+            unsigned links = 0;
+            std::size_t chained = 0;
+            while (links < SendBuffers && chained < n) {
+                std::size_t len = n - chained < SendBufferSize ? n - chained : SendBufferSize;
+                std::memcpy(mSendBufs[links].iov_base, p + chained, len);
+
+                io_uring_sqe* sqe = mSendRing.sqe();
+                sqe->fd = mFd;
+                sqe->addr = reinterpret_cast<uint64_t>(mSendBufs[links].iov_base);
+                sqe->len = static_cast<uint32_t>(len);
+                sqe->user_data = links;
+                if (mProfile.cork) {
+                    // Fixed writes take no flags, corking needs a plain send.
+                    // A short send doesn't break a chain like a short write
+                    // does, unless MSG_WAITALL makes it count as a failure.
+                    sqe->opcode = IORING_OP_SEND;
+                    sqe->msg_flags = MSG_WAITALL;
+                    if (more || chained + len < n)
+                        sqe->msg_flags |= MSG_MORE;
+                } else {
+                    sqe->opcode = IORING_OP_WRITE_FIXED;
+                    sqe->off = static_cast<uint64_t>(-1);
+                    sqe->buf_index = links;
+                }
+                if (chained + len < n && links + 1 < SendBuffers)
+                    sqe->flags |= IOSQE_IO_LINK;
+
+                mSendLens[links] = len;
+                chained += len;
+                links++;
+            }
+
+            if (!mSendRing.submit(links)) return false;
+
+            // A short write or send breaks the chain and cancels the following
+            // links, the next round starts right after the last byte written
+            std::size_t written = 0;
+            bool broken = false;
+            for (unsigned i = 0; i < links; i++) {
+                io_uring_cqe* cqe = mSendRing.wait();
+                if (!cqe) return false;
+                int res = cqe->res;
+                mSendResults[cqe->user_data] = res;
+                mSendRing.seen();
+            }
+            for (unsigned i = 0; i < links && !broken; i++) {
+                int res = mSendResults[i];
+                if (res < 0 && res != -ECANCELED) {
+                    spdlog::warn("Writer error occurs, details: {}", std::strerror(-res));
+                    return false;
+                }
+                if (res > 0) written += res;
+                broken = res != static_cast<int>(mSendLens[i]);
+            }
+
+            // Resubmitting a round that made no progress would never end
+            if (!written) {
+                spdlog::warn("Writer error occurs, details: no bytes written");
+                return false;
+            }
+
+            p += written;
+            n -= written;
+        }
+
+        return true;
+    }
+
+  private:
+    static constexpr unsigned RingEntries = 64;
+
+    static constexpr unsigned RecvBuffers = 32;
+    static constexpr std::size_t RecvBufferSize = 16 << 10;
+    static constexpr uint16_t RecvBufferGroup = 0;
+
+    static constexpr unsigned SendBuffers = 8;
+    static constexpr std::size_t SendBufferSize = 64 << 10;
+
+    void applyProfile(int fd) {
+        // Tuning is best effort, a rejected option only costs performance
+        int one = 1;
+        if (mProfile.noDelay && ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+            spdlog::warn("Failed to set TCP_NODELAY, details: {}", std::strerror(errno));
+        if (mProfile.sendBufferSize &&
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &mProfile.sendBufferSize, sizeof(mProfile.sendBufferSize)))
+            spdlog::warn("Failed to set SO_SNDBUF, details: {}", std::strerror(errno));
+        if (mProfile.receiveBufferSize &&
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &mProfile.receiveBufferSize, sizeof(mProfile.receiveBufferSize)))
+            spdlog::warn("Failed to set SO_RCVBUF, details: {}", std::strerror(errno));
+        if (mProfile.busyPollUs &&
+            ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &mProfile.busyPollUs, sizeof(mProfile.busyPollUs)))
+            spdlog::warn("Failed to set SO_BUSY_POLL, details: {}", std::strerror(errno));
+    }
+
+    char* recvBuffer(uint16_t bid) { return mRecvBufs.data() + bid * RecvBufferSize; }
+
+    bool setupRecvBuffers() {
+        mRecvBufs.resize(RecvBuffers * RecvBufferSize);
+
+        mBufRingSize = RecvBuffers * sizeof(io_uring_buf);
+        void* ring = ::mmap(nullptr, mBufRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (ring == MAP_FAILED) {
+            spdlog::warn("Failed to allocate buffer ring, details: {}", std::strerror(errno));
+            return false;
+        }
+        mBufRing = static_cast<io_uring_buf_ring*>(ring);
+
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(mBufRing);
+        reg.ring_entries = RecvBuffers;
+        reg.bgid = RecvBufferGroup;
+        if (mRecvRing.registerResource(IORING_REGISTER_PBUF_RING, &reg, 1)) {
+            spdlog::warn("Failed to register buffer ring, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        for (uint16_t bid = 0; bid < RecvBuffers; bid++)
+            recycleRecvBuffer(bid);
+
+        return true;
+    }
+
+    void recycleRecvBuffer(uint16_t bid) {
+        // Not mBufRing->bufs, the kernel header's flexible array macro gets
+        // a different offset when compiled as C++
+        io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(mBufRing) + (mBufRingTail & (RecvBuffers - 1));
+        buf->addr = reinterpret_cast<uint64_t>(recvBuffer(bid));
+        buf->len = static_cast<uint32_t>(RecvBufferSize);
+        buf->bid = bid;
+        __atomic_store_n(&mBufRing->tail, ++mBufRingTail, __ATOMIC_RELEASE);
+    }
+
+    bool armRecv() {
+        io_uring_sqe* sqe = mRecvRing.sqe();
+        if (!sqe) return false;
+
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = mFd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RecvBufferGroup;
+        if (mMultishot) sqe->ioprio = IORING_RECV_MULTISHOT;
+
+        mRecvArmed = mRecvRing.submit();
+        return mRecvArmed;
+    }
+
+    bool setupSendBuffers() {
+        mSendStorage.resize(SendBuffers * SendBufferSize);
+        for (unsigned i = 0; i < SendBuffers; i++) {
+            mSendBufs[i].iov_base = mSendStorage.data() + i * SendBufferSize;
+            mSendBufs[i].iov_len = SendBufferSize;
+        }
+
+        if (mSendRing.registerResource(IORING_REGISTER_BUFFERS, mSendBufs, SendBuffers)) {
+            spdlog::warn("Failed to register send buffers, details: {}", std::strerror(errno));
+            return false;
+        }
+
+        return true;
+    }
+
+    TransportProfile mProfile;
+
+    int mFd = -1;
+
+    // Owned by the Receiver thread
+    Uring mRecvRing;
+    io_uring_buf_ring* mBufRing = nullptr;
+    std::size_t mBufRingSize = 0;
+    uint16_t mBufRingTail = 0;
+    std::vector<char> mRecvBufs;
+    bool mMultishot = true;
+    bool mRecvArmed = false;
+    uint16_t mRecvBid = 0;
+    std::size_t mRecvOffset = 0;
+    std::size_t mRecvLen = 0;
+
+    // Owned by the Sender thread
+    Uring mSendRing;
+    std::vector<char> mSendStorage;
+    iovec mSendBufs[SendBuffers];
+    std::size_t mSendLens[SendBuffers];
+    int mSendResults[SendBuffers];
+};
+
+}  // namespace Protocon
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Transport.h"
+#include "Util.h"
+
+namespace Protocon {
+
+// In-memory transport. Reads are served from what has been fed to it and
+// report EOF once that runs out, writes are recorded.
+class FakeTransport : public Transport {
+  public:
+    struct Write {
+        const char* buf;
+        std::string data;
+        bool more;
+    };
+
+    FakeTransport() {}
+    explicit FakeTransport(std::string input) : mInput(std::move(input)) {}
+
+    bool connect(const char* host, uint16_t port) override { return true; }
+    bool is_open() const override { return true; }
+    bool shutdown() override { return true; }
+    bool shutdownSend() override { return true; }
+
+    bool write(const void* buf, std::size_t n, bool more) override {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mWrites.push_back(Write{static_cast<const char*>(buf), std::string(static_cast<const char*>(buf), n), more});
+        return true;
+    }
+
+    std::size_t read(void* buf, std::size_t n) override {
+        std::lock_guard<std::mutex> lock(mMtx);
+        std::size_t len = std::min(n, mInput.size() - mOffset);
+        std::memcpy(buf, mInput.data() + mOffset, len);
+        mOffset += len;
+        return len;
+    }
+
+    void feed(const std::string& data) {
+        std::lock_guard<std::mutex> lock(mMtx);
+        mInput += data;
+    }
+
+    std::vector<Write> writes() {
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mWrites;
+    }
+
+    // Everything written so far, back to back
+    std::string written() {
+        std::lock_guard<std::mutex> lock(mMtx);
+        std::string data;
+        for (const auto& w : mWrites)
+            data += w.data;
+        return data;
+    }
+
+  private:
+    std::mutex mMtx;
+    std::string mInput;
+    std::size_t mOffset = 0;
+    std::vector<Write> mWrites;
+};
+
+// Frames as a server puts them on the wire
+class Wire {
+  public:
+    template <typename T>
+    static void Put(std::string& s, T v) {
+        v = Util::BigEndian(v);
+        s.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static std::string RequestFrame(uint16_t cmdId, uint64_t clientId, uint16_t type, uint64_t time,
+                                    const std::string& data, uint64_t gatewayId = 1, uint16_t apiVersion = 1) {
+        std::string s;
+        s += '\x00';
+        Put(s, cmdId);
+        Put(s, gatewayId);
+        Put(s, clientId);
+        Put(s, time);
+        Put(s, apiVersion);
+        Put(s, type);
+        Put(s, static_cast<uint32_t>(data.size()));
+        s += data;
+        return s;
+    }
+
+    static std::string ResponseFrame(uint16_t cmdId, uint64_t time, uint8_t status, const std::string& data) {
+        std::string s;
+        s += '\x80';
+        Put(s, cmdId);
+        Put(s, time);
+        s += static_cast<char>(status);
+        Put(s, static_cast<uint32_t>(data.size()));
+        s += data;
+        return s;
+    }
+
+    static std::string SignUpResponseFrame(uint16_t cmdId, uint64_t clientId, uint8_t status) {
+        std::string s;
+        s += '\x81';
+        Put(s, cmdId);
+        Put(s, clientId);
+        s += static_cast<char>(status);
+        return s;
+    }
+
+    static std::string HeartbeatAckFrame(uint16_t cmdId, uint64_t time) {
+        std::string s;
+        s += '\x83';
+        Put(s, cmdId);
+        Put(s, time);
+        return s;
+    }
+
+  private:
+    Wire() {}
+};
+
+}  // namespace Protocon
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Protocon/Request.h>
+#include <Protocon/Response.h>
+
+#include <asio/connect.hpp>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "FakeTransport.h"
+#include "Util.h"
+
+namespace Protocon {
+
+// Loopback server for one gateway: writes a fixed byte stream once the
+// gateway has connected, and collects the requests and responses the gateway
+// sends back
+class ScriptedServer {
+  public:
+    ScriptedServer()
+        : mAcceptor(mContext, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)),
+          mSocket(mContext) {}
+
+    ~ScriptedServer() {
+        asio::error_code ec;
+        mSocket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        if (mHandle.joinable()) mHandle.join();
+    }
+
+    uint16_t port() const { return mAcceptor.local_endpoint().port(); }
+
+    void serve(std::string stream) {
+        mHandle = std::thread([this, stream = std::move(stream)] {
+            try {
+                mAcceptor.accept(mSocket);
+                asio::write(mSocket, asio::buffer(stream));
+                while (readFrame())
+                    ;
+            } catch (std::exception&) {
+                // Closed by the gateway or by the destructor
+            }
+        });
+    }
+
+    // Waits until `n` responses have arrived or a second has passed
+    std::vector<std::pair<uint16_t, Response>> responses(std::size_t n) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (std::chrono::steady_clock::now() < deadline) {
+            {
+                std::lock_guard<std::mutex> lock(mMtx);
+                if (mResponses.size() >= n) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mResponses;
+    }
+
+    // Waits until `n` requests have arrived or a second has passed
+    std::vector<std::pair<uint16_t, Request>> requests(std::size_t n) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (std::chrono::steady_clock::now() < deadline) {
+            {
+                std::lock_guard<std::mutex> lock(mMtx);
+                if (mRequests.size() >= n) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        std::lock_guard<std::mutex> lock(mMtx);
+        return mRequests;
+    }
+
+  private:
+    template <typename T>
+    T get() {
+        T v;
+        asio::read(mSocket, asio::buffer(&v, sizeof(v)));
+        return Util::BigEndian(v);
+    }
+
+    void skip(std::size_t n) {
+        std::string s(n, '\0');
+        asio::read(mSocket, asio::buffer(&s[0], n));
+    }
+
+    // Requests and responses are kept, everything else is skipped
+    bool readFrame() {
+        uint8_t flag;
+        asio::read(mSocket, asio::buffer(&flag, sizeof(flag)));
+        uint16_t cmdId = get<uint16_t>();
+
+        if (flag == 0x80) {
+            Response r;
+            r.time = get<uint64_t>();
+            asio::read(mSocket, asio::buffer(&r.status, sizeof(r.status)));
+            r.data.resize(get<uint32_t>());
+            if (!r.data.empty()) asio::read(mSocket, asio::buffer(&r.data[0], r.data.size()));
+
+            std::lock_guard<std::mutex> lock(mMtx);
+            mResponses.emplace_back(cmdId, std::move(r));
+        } else if (flag == 0x00) {
+            Request r;
+            skip(2 * sizeof(uint64_t));
+            r.time = get<uint64_t>();
+            skip(sizeof(uint16_t));
+            r.type = get<uint16_t>();
+            r.data.resize(get<uint32_t>());
+            if (!r.data.empty()) asio::read(mSocket, asio::buffer(&r.data[0], r.data.size()));
+
+            std::lock_guard<std::mutex> lock(mMtx);
+            mRequests.emplace_back(cmdId, std::move(r));
+        } else if (flag == 0x01) {
+            skip(sizeof(uint64_t));
+        } else if (flag == 0x02 || flag == 0x03) {
+            skip(2 * sizeof(uint64_t));
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    asio::io_context mContext;
+    asio::ip::tcp::acceptor mAcceptor;
+    asio::ip::tcp::socket mSocket;
+
+    std::mutex mMtx;
+    std::vector<std::pair<uint16_t, Request>> mRequests;
+    std::vector<std::pair<uint16_t, Response>> mResponses;
+
+    std::thread mHandle;
+};
+
+}  // namespace Protocon
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "FakeTransport.h"
+#include "RawCommand.h"
+#include "Receiver.h"
+#include "ThreadSafeQueue.h"
+#include "Transport.h"
+#include "Util.h"
+
+using namespace Protocon;
+
+static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+class TestAdmission : public testing::Test {
+  protected:
+    void receive(const std::string& stream, const AdmissionOptions& admission,
+                 std::function<bool(uint16_t)> handles = nullptr) {
+        FakeTransport transport(stream);
+        Receiver receiver(transport, mRequests, mResponses, mSignUpResponses, mSignInResponses,
+                          nullptr, nullptr, admission, &mBusyResponses, ThreadOptions(), nullptr, std::move(handles));
+        receiver.run();
+        while (receiver.running())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        receiver.stop();
+        mShed = receiver.shedRequests();
+    }
+
+    ThreadSafeQueue<RawRequest> mRequests;
+    ThreadSafeQueue<RawResponse> mResponses;
+    ThreadSafeQueue<RawSignUpResponse> mSignUpResponses;
+    ThreadSafeQueue<RawSignInResponse> mSignInResponses;
+    ThreadSafeQueue<RawResponse> mBusyResponses;
+    std::size_t mShed = 0;
+};
+
+TEST_F(TestAdmission, QueueDepth) {
+    std::string stream;
+    for (uint16_t i = 0; i < 5; i++)
+        stream += Wire::RequestFrame(i, 2, 0x0001, Now(), "{}", 1, 2);
+
+    AdmissionOptions admission;
+    admission.maxQueuedRequests = 2;
+    admission.busyStatus = 0x42;
+    receive(stream, admission);
+
+    EXPECT_EQ(mRequests.size(), 2u);
+    EXPECT_EQ(mShed, 3u);
+
+    ASSERT_EQ(mBusyResponses.size(), 3u);
+    RawResponse r = mBusyResponses.pop();
+    EXPECT_EQ(r.cmdId, 2);
+    EXPECT_EQ(r.response.status, 0x42);
+}
+
+TEST_F(TestAdmission, RequestAge) {
+    std::string stream = Wire::RequestFrame(1, 2, 0x0001, Now() - 60, "{}", 1, 2) +
+                         Wire::RequestFrame(2, 2, 0x0001, Now(), "{}", 1, 2);
+
+    AdmissionOptions admission;
+    admission.maxRequestAge = std::chrono::seconds(10);
+    receive(stream, admission);
+
+    ASSERT_EQ(mRequests.size(), 1u);
+    EXPECT_EQ(mRequests.pop().cmdId, 2);
+    ASSERT_EQ(mBusyResponses.size(), 1u);
+    RawResponse r = mBusyResponses.pop();
+    EXPECT_EQ(r.cmdId, 1);
+    // Stamped when it was shed, not with the request's time
+    EXPECT_GE(r.response.time, Now() - 1);
+}
+
+TEST_F(TestAdmission, Disabled) {
+    std::string stream;
+    for (uint16_t i = 0; i < 5; i++)
+        stream += Wire::RequestFrame(i, 2, 0x0001, 0, "{}", 1, 2);
+
+    receive(stream, AdmissionOptions());
+
+    EXPECT_EQ(mRequests.size(), 5u);
+    EXPECT_EQ(mBusyResponses.size(), 0u);
+}
+
+TEST_F(TestAdmission, UnhandledTypesAreNotShed) {
+    std::string stream = Wire::RequestFrame(1, 2, 0x0001, Now() - 60, "{}", 1, 2) +
+                         Wire::RequestFrame(2, 2, 0x0002, Now() - 60, "{}", 1, 2);
+
+    AdmissionOptions admission;
+    admission.maxRequestAge = std::chrono::seconds(10);
+    receive(stream, admission, [](uint16_t type) { return type == 0x0001; });
+
+    // The gateway drops the second one without an answer, so must admission
+    ASSERT_EQ(mBusyResponses.size(), 1u);
+    EXPECT_EQ(mBusyResponses.pop().cmdId, 1);
+    EXPECT_EQ(mShed, 1u);
+    ASSERT_EQ(mRequests.size(), 1u);
+    EXPECT_EQ(mRequests.pop().cmdId, 2);
+}
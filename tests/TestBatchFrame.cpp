@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "BatchFrame.h"
+#include "FakeTransport.h"
+#include "RawCommand.h"
+#include "Receiver.h"
+#include "Sender.h"
+#include "ThreadSafeQueue.h"
+#include "Transport.h"
+#include "Util.h"
+
+using namespace Protocon;
+using namespace std::chrono_literals;
+
+namespace {
+
+void send(FakeTransport& transport, ThreadSafeQueue<RawRequest>& requests, ThreadSafeQueue<RawResponse>& responses) {
+    ThreadSafeQueue<RawSignUpRequest> signUpRequests;
+    ThreadSafeQueue<RawSignInRequest> signInRequests;
+
+    TransportProfile profile;
+    profile.idleInterval = 1ms;
+    profile.batchFrames = true;
+
+    Sender sender(transport, requests, responses, signUpRequests, signInRequests, profile);
+
+    auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+
+    sender.run();
+    std::this_thread::sleep_for(50ms);
+    sender.stop();
+
+    spdlog::set_level(level);
+}
+
+}  // namespace
+
+TEST(TestBatchFrame, RoundTrip) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+
+    requests.emplace(RawRequest{1, 7, 100, 3, Request{0, 0x0001, "{\"a\":1}"}});
+    // Needs a multi-byte varint
+    requests.emplace(RawRequest{2, 7, uint64_t(1) << 40, 3, Request{0, 0x0002, ""}});
+    requests.emplace(RawRequest{3, 7, 101, 3, Request{0, 0x0001, std::string(300, 'x')}});
+    responses.emplace(RawResponse{9, Response{0, 0x05, "{}"}});
+
+    FakeTransport transport;
+    send(transport, requests, responses);
+
+    std::string data = transport.written();
+    ASSERT_EQ(transport.writes().size(), 1u);
+    const std::size_t headerSize = BatchFrame::HeaderSize;
+    ASSERT_GE(data.size(), headerSize);
+    EXPECT_EQ(uint8_t(data[0]), 0x04);
+
+    uint16_t count;
+    std::memcpy(&count, data.data() + 1, sizeof(count));
+    EXPECT_EQ(Util::BigEndian(count), 4u);
+
+    // Smaller than four frames of their own
+    EXPECT_LT(data.size(), 3 * 35u + 16 + 7 + 300 + 2);
+
+    ThreadSafeQueue<RawSignUpResponse> signUpResponses;
+    ThreadSafeQueue<RawSignInResponse> signInResponses;
+    transport.feed(data);
+    Receiver receiver(transport, requests, responses, signUpResponses, signInResponses);
+    receiver.run();
+    while (receiver.running())
+        std::this_thread::sleep_for(1ms);
+    receiver.stop();
+
+    // Responses are sent ahead of requests
+    ASSERT_EQ(responses.size(), 1u);
+    RawResponse response = responses.pop();
+    EXPECT_EQ(response.cmdId, 9);
+    EXPECT_EQ(response.response.status, 0x05);
+    EXPECT_EQ(response.response.data, "{}");
+
+    ASSERT_EQ(requests.size(), 3u);
+    RawRequest r = requests.pop();
+    EXPECT_EQ(r.cmdId, 1);
+    EXPECT_EQ(r.gatewayId, 7u);
+    EXPECT_EQ(r.clientId, 100u);
+    EXPECT_EQ(r.apiVersion, 3);
+    EXPECT_EQ(r.request.type, 0x0001);
+    EXPECT_EQ(r.request.data, "{\"a\":1}");
+    EXPECT_EQ(r.request.time, response.response.time);
+
+    r = requests.pop();
+    EXPECT_EQ(r.clientId, uint64_t(1) << 40);
+    EXPECT_EQ(r.request.type, 0x0002);
+    EXPECT_TRUE(r.request.data.empty());
+
+    r = requests.pop();
+    EXPECT_EQ(r.cmdId, 3);
+    EXPECT_EQ(r.request.data, std::string(300, 'x'));
+}
+
+TEST(TestBatchFrame, LoneFrameIsNotBatched) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+
+    requests.emplace(RawRequest{1, 7, 100, 3, Request{0, 0x0001, "{}"}});
+
+    FakeTransport transport;
+    send(transport, requests, responses);
+
+    std::string data = transport.written();
+    ASSERT_EQ(data.size(), 35u + 2);
+    EXPECT_EQ(uint8_t(data[0]), 0x00);
+}
+
+TEST(TestBatchFrame, ResponsesKeepTheirTime) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+
+    responses.emplace(RawResponse{1, Response{100, 0x00, "a"}});
+    responses.emplace(RawResponse{2, Response{100, 0x00, "b"}});
+    // A batch has one time, this one needs a frame of its own
+    responses.emplace(RawResponse{3, Response{200, 0x00, "c"}});
+
+    FakeTransport transport;
+    send(transport, requests, responses);
+
+    std::string data = transport.written();
+    ThreadSafeQueue<RawSignUpResponse> signUpResponses;
+    ThreadSafeQueue<RawSignInResponse> signInResponses;
+    transport.feed(data);
+    Receiver receiver(transport, requests, responses, signUpResponses, signInResponses);
+    receiver.run();
+    while (receiver.running())
+        std::this_thread::sleep_for(1ms);
+    receiver.stop();
+
+    ASSERT_EQ(responses.size(), 3u);
+    EXPECT_EQ(responses.pop().response.time, 100u);
+    EXPECT_EQ(responses.pop().response.time, 100u);
+    RawResponse r = responses.pop();
+    EXPECT_EQ(r.cmdId, 3);
+    EXPECT_EQ(r.response.time, 200u);
+}
@@ -0,0 +1,81 @@
+#include <Protocon/Replay.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "Capture.h"
+
+using Protocon::Capture;
+using Protocon::CaptureReader;
+using Protocon::CaptureWriter;
+
+TEST(TestCapture, RoundTrip) {
+    std::string path = testing::TempDir() + "TestCapture.bin";
+
+    {
+        CaptureWriter writer;
+        ASSERT_TRUE(writer.open(path));
+        writer.append(Capture::Inbound, "abc", 3);
+        writer.append(Capture::Outbound, "", 0);
+        writer.append(Capture::Inbound, std::string(1 << 20, 'x').data(), 1 << 20);
+    }
+
+    CaptureReader reader;
+    ASSERT_TRUE(reader.open(path));
+
+    CaptureReader::Record r;
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.direction, Capture::Inbound);
+    EXPECT_EQ(std::string(r.data, r.length), "abc");
+    uint64_t time = r.time;
+
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.direction, Capture::Outbound);
+    EXPECT_EQ(r.length, 0u);
+    EXPECT_GE(r.time, time);
+
+    ASSERT_TRUE(reader.next(r));
+    EXPECT_EQ(r.length, 1u << 20);
+
+    EXPECT_FALSE(reader.next(r));
+
+    std::remove(path.c_str());
+}
+
+// serve() blocks in accept() until a gateway shows up, close() lets it go
+static void CloseBeforeGateway(Protocon::Replay& replay) {
+    std::size_t frames = 1;
+    std::thread server([&] { frames = replay.serve(false); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    replay.close();
+    server.join();
+    EXPECT_EQ(frames, 0u);
+}
+
+TEST(TestCapture, ReplayClose) {
+    std::string path = testing::TempDir() + "TestCaptureReplay.bin";
+    {
+        CaptureWriter writer;
+        ASSERT_TRUE(writer.open(path));
+        writer.append(Capture::Inbound, "abc", 3);
+    }
+
+    {
+        Protocon::Replay replay(path);
+        ASSERT_TRUE(replay.listen(0));
+        CloseBeforeGateway(replay);
+    }
+
+#ifdef __linux__
+    {
+        Protocon::Replay replay(path);
+        ASSERT_TRUE(replay.listenSharedMemory("/protocon-test-replay"));
+        CloseBeforeGateway(replay);
+    }
+#endif
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "Connector.h"
+
+using Protocon::Connector;
+using Protocon::Endpoint;
+
+using namespace std::chrono_literals;
+
+class TestConnector : public testing::Test {
+  protected:
+    TestConnector()
+        : mAcceptor(mContext, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)),
+          mSocket(mContext) {}
+
+    uint16_t port() const { return mAcceptor.local_endpoint().port(); }
+
+    // A port nobody listens on
+    uint16_t closedPort() {
+        asio::ip::tcp::acceptor acceptor(mContext, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+        return acceptor.local_endpoint().port();
+    }
+
+    asio::io_context mContext;
+    asio::ip::tcp::acceptor mAcceptor;
+    asio::ip::tcp::socket mSocket;
+};
+
+TEST_F(TestConnector, ResolvesHostName) {
+    Connector connector(mContext, 250ms, 5s);
+    ASSERT_TRUE(connector.connect({Endpoint{"localhost", port()}}, mSocket));
+    EXPECT_EQ(mSocket.remote_endpoint().port(), port());
+}
+
+TEST_F(TestConnector, FailsOverWithoutWaiting) {
+    Connector connector(mContext, 2s, 5s);
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(connector.connect({Endpoint{"127.0.0.1", closedPort()}, Endpoint{"127.0.0.1", port()}}, mSocket));
+
+    // The refused attempt starts the next one right away
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+    EXPECT_EQ(mSocket.remote_endpoint().port(), port());
+}
+
+TEST_F(TestConnector, AllRefused) {
+    Connector connector(mContext, 250ms, 5s);
+    EXPECT_FALSE(connector.connect({Endpoint{"127.0.0.1", closedPort()}}, mSocket));
+    EXPECT_FALSE(mSocket.is_open());
+}
+
+TEST_F(TestConnector, UnknownHost) {
+    Connector connector(mContext, 250ms, 5s);
+    EXPECT_FALSE(connector.connect({Endpoint{"host.invalid", port()}}, mSocket));
+}
+
+TEST_F(TestConnector, Deadline) {
+    Connector connector(mContext, 50ms, 300ms);
+
+    // Non-routable, the SYN goes unanswered (or the network is unreachable)
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(connector.connect({Endpoint{"10.255.255.1", 9}}, mSocket));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 2s);
+}
+
+TEST_F(TestConnector, DeadlineWhileResolving) {
+    // A DNS server that takes longer than the connect timeout
+    Connector connector(mContext, 50ms, 300ms, [](const std::string&, const std::string&, asio::error_code& ec) {
+        std::this_thread::sleep_for(2s);
+        ec = asio::error::host_not_found;
+        return asio::ip::tcp::resolver::results_type();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(connector.connect({Endpoint{"slow.example", port()}}, mSocket));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+}
+
+TEST_F(TestConnector, SlowResolveDoesNotHoldBackOthers) {
+    Connector connector(mContext, 50ms, 5s, [](const std::string& host, const std::string& service, asio::error_code& ec) {
+        if (host == "slow.example") std::this_thread::sleep_for(2s);
+        return Connector::SystemResolve(host == "slow.example" ? "127.0.0.1" : host, service, ec);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(connector.connect({Endpoint{"slow.example", port()}, Endpoint{"localhost", port()}}, mSocket));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+    EXPECT_EQ(mSocket.remote_endpoint().port(), port());
+}
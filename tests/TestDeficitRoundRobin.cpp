@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "DeficitRoundRobin.h"
+
+using Protocon::DeficitRoundRobin;
+
+TEST(TestDeficitRoundRobin, FifoWithinKey) {
+    DeficitRoundRobin<int, int> q(10);
+    for (int i = 0; i < 5; i++)
+        q.push(1, int(i), 3);
+
+    for (int i = 0; i < 5; i++)
+        EXPECT_EQ(q.pop(), i);
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(TestDeficitRoundRobin, HeavyKeyDoesNotStarveLightKey) {
+    DeficitRoundRobin<int, std::string> q(100);
+    for (int i = 0; i < 100; i++)
+        q.push(1, "bulk", 100);
+    q.push(2, "interactive", 10);
+
+    std::vector<std::string> order;
+    for (int i = 0; i < 3; i++)
+        order.emplace_back(q.pop());
+
+    EXPECT_EQ(order[0], "bulk");
+    EXPECT_EQ(order[1], "interactive");
+    EXPECT_EQ(order[2], "bulk");
+}
+
+TEST(TestDeficitRoundRobin, SharesBytesNotItems) {
+    DeficitRoundRobin<int, int> q(100);
+    for (int i = 0; i < 10; i++) {
+        q.push(1, 1, 100);
+        q.push(2, 2, 25);
+        q.push(2, 2, 25);
+        q.push(2, 2, 25);
+        q.push(2, 2, 25);
+    }
+
+    int small = 0;
+    for (int i = 0; i < 10; i++)
+        small += q.pop() == 2;
+
+    // Each round is one 100 byte item from key 1 and four 25 byte items from key 2
+    EXPECT_EQ(small, 8);
+}
+
+TEST(TestDeficitRoundRobin, OversizedItemEventuallySent) {
+    DeficitRoundRobin<int, int> q(10);
+    q.push(1, 42, 35);
+    EXPECT_EQ(q.pop(), 42);
+    EXPECT_TRUE(q.empty());
+}
@@ -0,0 +1,236 @@
+#include <Protocon/Protocon.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ScriptedServer.h"
+#include "Util.h"
+
+using namespace Protocon;
+
+namespace {
+
+// Polls until the server has `n` responses or a second has passed
+void pollFor(Gateway& gateway, ScriptedServer& server, std::size_t n) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (server.responses(0).size() < n && std::chrono::steady_clock::now() < deadline) {
+        gateway.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Polls until `done` or a second has passed
+template <typename F>
+void pollUntil(Gateway& gateway, F done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        gateway.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Request payload carrying its sequence number
+std::string sequenced(int seq) {
+    char prefix[16];
+    std::snprintf(prefix, sizeof(prefix), "%08d", seq);
+    return prefix + std::string(16 << 10, 'x');
+}
+
+// Sequence numbers of the complete request frames in a byte stream
+std::vector<int> sequences(const std::string& data) {
+    std::vector<int> result;
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        if (data[offset] == 0x02) {
+            offset += 19;
+            continue;
+        }
+        if (data[offset] != 0x00 || offset + 35 > data.size()) break;
+        uint32_t len;
+        std::memcpy(&len, data.data() + offset + 31, sizeof(len));
+        len = Util::BigEndian(len);
+        if (offset + 35 + len > data.size()) break;
+        result.push_back(std::stoi(data.substr(offset + 35, 8)));
+        offset += 35 + len;
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST(TestGateway, RequestRightAfterRegistration) {
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    auto gateway = GatewayBuilder(1)
+                       .withTransportProfile(profile)
+                       .withRequestHandler(0x0001, [](ClientToken, const Request&) { return Response{0, 0x00, "ok"}; })
+                       .build();
+    ClientToken tk = gateway.createClientToken();
+
+    ScriptedServer server;
+    server.serve(Wire::SignUpResponseFrame(0, 5, 0x00) + Wire::RequestFrame(1, 5, 0x0001, 0, "{}"));
+
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+    // Both frames are queued before the first poll()
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    pollFor(gateway, server, 1);
+    gateway.stop();
+
+    EXPECT_EQ(gateway.clientId(tk), 5u);
+    auto responses = server.responses(1);
+    ASSERT_EQ(responses.size(), 1u);
+    EXPECT_EQ(responses[0].first, 1);
+    EXPECT_EQ(responses[0].second.data, "ok");
+}
+
+TEST(TestGateway, SpilledRequestsKeepTheirOrderAcrossRestart) {
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    profile.sendBufferSize = 16 << 10;
+    // One frame per write, so a failed write loses at most one
+    profile.maxBatchBytes = 1;
+    auto gateway = GatewayBuilder(1)
+                       .withTransportProfile(profile)
+                       .withSpill(testing::TempDir() + "TestGatewaySpill")
+                       .build();
+    ClientToken tk = gateway.createClientToken(5);
+
+    // A server that stops reading, the Sender blocks with requests in its
+    // lane and more queued behind them
+    asio::io_context context;
+    asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+    acceptor.set_option(asio::socket_base::receive_buffer_size(16 << 10));
+    asio::ip::tcp::socket stalled(context);
+    std::thread accept([&] { acceptor.accept(stalled); });
+    ASSERT_TRUE(gateway.run("127.0.0.1", acceptor.local_endpoint().port()));
+    accept.join();
+
+    const int total = 200;
+    for (int i = 0; i < total / 2; i++)
+        gateway.send(tk, Request{0, 0x0001, sequenced(i)}, [](const Response&) {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    gateway.stop();
+
+    // Disconnected, these go to disk
+    for (int i = total / 2; i < total; i++)
+        gateway.send(tk, Request{0, 0x0001, sequenced(i)}, [](const Response&) {});
+    EXPECT_EQ(gateway.spilledRequests(), static_cast<std::size_t>(total / 2));
+
+    std::string delivered;
+    std::array<char, 64 << 10> buf;
+    asio::error_code ec;
+    while (!ec) {
+        std::size_t len = stalled.read_some(asio::buffer(buf), ec);
+        delivered.append(buf.data(), len);
+    }
+    auto before = sequences(delivered);
+
+    ScriptedServer server;
+    server.serve("");
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+    auto requests = server.requests(total - before.size() - 1);
+    gateway.stop();
+
+    // Everything after the frame that was being written when the connection
+    // went down arrives, oldest first
+    ASSERT_FALSE(requests.empty());
+    int next = std::stoi(requests[0].second.data.substr(0, 8));
+    EXPECT_LE(next, (before.empty() ? -1 : before.back()) + 2);
+    for (const auto& it : requests)
+        EXPECT_EQ(std::stoi(it.second.data.substr(0, 8)), next++);
+    EXPECT_EQ(next, total);
+}
+
+TEST(TestGateway, Broadcast) {
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    auto gateway = GatewayBuilder(1).withTransportProfile(profile).build();
+    std::vector<ClientToken> tks = {gateway.createClientToken(5), gateway.createClientToken(6),
+                                    gateway.createClientToken(7)};
+
+    // Sign-ins take command IDs 0 to 2, the broadcast gets one per client
+    // in the order of tks
+    ScriptedServer server;
+    server.serve(Wire::ResponseFrame(3, 0, 0x00, "a") + Wire::ResponseFrame(4, 0, 0x00, "b") +
+                 Wire::ResponseFrame(5, 0, 0x00, "c"));
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+
+    // An unknown client fails the whole broadcast before anything is sent
+    std::vector<ClientToken> unknown = tks;
+    unknown.push_back(ClientToken{100});
+    EXPECT_THROW(gateway.broadcast(unknown, Request{0, 0x0001, "{}"}, [](ClientToken, const Response&) {}),
+                 std::out_of_range);
+
+    std::map<uint64_t, std::string> responses;
+    gateway.broadcast(tks, Request{0, 0x0001, "{}"}, [&](ClientToken tk, const Response& r) {
+        responses[gateway.clientId(tk)] = r.data;
+    });
+    pollUntil(gateway, [&] { return responses.size() == 3; });
+
+    auto requests = server.requests(3);
+    gateway.stop();
+
+    std::map<uint64_t, std::string> expected = {{5, "a"}, {6, "b"}, {7, "c"}};
+    EXPECT_EQ(responses, expected);
+    ASSERT_EQ(requests.size(), 3u);
+    for (uint16_t i = 0; i < 3; i++) {
+        EXPECT_EQ(requests[i].first, 3 + i);
+        EXPECT_EQ(requests[i].second.data, "{}");
+    }
+}
+
+TEST(TestGateway, BroadcastCollect) {
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    auto gateway = GatewayBuilder(1).withTransportProfile(profile).build();
+    std::vector<ClientToken> tks = {gateway.createClientToken(5), gateway.createClientToken(6),
+                                    gateway.createClientToken(7)};
+
+    // Answered in reverse, delivered in the order of tks
+    ScriptedServer server;
+    server.serve(Wire::ResponseFrame(5, 0, 0x00, "c") + Wire::ResponseFrame(4, 0, 0x01, "b") +
+                 Wire::ResponseFrame(3, 0, 0x00, "a"));
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+
+    int calls = 0;
+    std::vector<std::pair<ClientToken, Response>> collected;
+    gateway.broadcastCollect(tks, Request{0, 0x0001, "{}"}, [&](const std::vector<std::pair<ClientToken, Response>>& r) {
+        calls++;
+        collected = r;
+    });
+    pollUntil(gateway, [&] { return calls > 0; });
+    gateway.stop();
+
+    EXPECT_EQ(calls, 1);
+    ASSERT_EQ(collected.size(), 3u);
+    const char* data[] = {"a", "b", "c"};
+    for (std::size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(collected[i].first, tks[i]);
+        EXPECT_EQ(collected[i].second.data, data[i]);
+    }
+    EXPECT_EQ(collected[1].second.status, 0x01);
+}
+
+TEST(TestGateway, BroadcastBeyondCommandIds) {
+    auto gateway = GatewayBuilder(1).build();
+    std::vector<ClientToken> tks;
+    for (std::size_t i = 0; i <= 1 << 16; i++)
+        tks.push_back(gateway.createClientToken(i + 1));
+
+    // Rejected before a command ID is reused and a handler lost
+    bool called = false;
+    EXPECT_THROW(gateway.broadcastCollect(tks, Request{0, 0x0001, "{}"},
+                                          [&](const std::vector<std::pair<ClientToken, Response>>&) { called = true; }),
+                 std::length_error);
+    EXPECT_FALSE(called);
+}
@@ -0,0 +1,87 @@
+#include <Protocon/Protocon.h>
+#include <gtest/gtest.h>
+
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "FakeTransport.h"
+#include "Liveness.h"
+#include "RawCommand.h"
+#include "Receiver.h"
+#include "ThreadSafeQueue.h"
+#include "Transport.h"
+#include "Util.h"
+
+using namespace Protocon;
+using namespace std::chrono_literals;
+
+TEST(TestHeartbeat, SmoothedRtt) {
+    Liveness liveness;
+    liveness.sample(100us);
+
+    RttStats stats = liveness.stats();
+    EXPECT_EQ(stats.srtt, 100us);
+    EXPECT_EQ(stats.rttvar, 50us);
+    EXPECT_EQ(stats.rto, 300us);
+
+    liveness.sample(200us);
+    stats = liveness.stats();
+    EXPECT_EQ(stats.srtt, 112us);
+    EXPECT_EQ(stats.rttvar, 62us);
+    EXPECT_EQ(stats.samples, 2u);
+}
+
+TEST(TestHeartbeat, ReceiverSamplesAcks) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+    ThreadSafeQueue<RawSignUpResponse> signUpResponses;
+    ThreadSafeQueue<RawSignInResponse> signInResponses;
+
+    Liveness liveness;
+    FakeTransport transport(Wire::HeartbeatAckFrame(1, Liveness::Now() - 2000000));
+    Receiver receiver(transport, requests, responses, signUpResponses, signInResponses,
+                      nullptr, nullptr, AdmissionOptions(), nullptr, ThreadOptions(), &liveness);
+    receiver.run();
+    while (receiver.running())
+        std::this_thread::sleep_for(1ms);
+    receiver.stop();
+
+    RttStats stats = liveness.stats();
+    ASSERT_EQ(stats.samples, 1u);
+    EXPECT_GE(stats.srtt, 2ms);
+}
+
+TEST(TestHeartbeat, SilentServer) {
+    // Connections complete in the backlog, nothing is ever read or answered
+    asio::io_context context;
+    asio::ip::tcp::acceptor acceptor(context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+
+    HeartbeatOptions heartbeat;
+    heartbeat.interval = 10ms;
+    heartbeat.deadTimeout = 200ms;
+    heartbeat.maxRequestTimeout = 50ms;
+    heartbeat.timeoutStatus = 0x42;
+
+    auto gateway = GatewayBuilder(1).withHeartbeat(heartbeat).build();
+    auto tk = gateway.createClientToken(1);
+    ASSERT_TRUE(gateway.run("127.0.0.1", acceptor.local_endpoint().port()));
+
+    uint8_t status = 0;
+    gateway.send(tk, Request{0, 0x0001, "{}"}, [&status](const Response& r) { status = r.status; });
+
+    auto start = std::chrono::steady_clock::now();
+    while (gateway.isOpen() && std::chrono::steady_clock::now() - start < 2s) {
+        gateway.poll();
+        std::this_thread::sleep_for(1ms);
+    }
+
+    EXPECT_FALSE(gateway.isOpen());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+    EXPECT_EQ(status, 0x42);
+
+    gateway.stop();
+}
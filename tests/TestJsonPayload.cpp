@@ -0,0 +1,112 @@
+#include <Protocon/JsonPayload.h>
+#include <Protocon/Protocon.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "ScriptedServer.h"
+
+using Protocon::ClientToken;
+using Protocon::JsonPayload;
+using Protocon::Request;
+using Protocon::Response;
+
+TEST(TestJsonPayload, Fields) {
+    std::string data = R"({"id": 42, "name": "gateway", "ratio": 0.5, "ok": true, "big": 18446744073709551615})";
+    JsonPayload json(data);
+
+    // Out of order lookups wrap around
+    std::string name;
+    ASSERT_TRUE(json.get("name", name));
+    EXPECT_EQ(name, "gateway");
+
+    int64_t id;
+    ASSERT_TRUE(json.get("id", id));
+    EXPECT_EQ(id, 42);
+
+    uint64_t big;
+    ASSERT_TRUE(json.get("big", big));
+    EXPECT_EQ(big, UINT64_MAX);
+
+    double ratio;
+    ASSERT_TRUE(json.get("ratio", ratio));
+    EXPECT_DOUBLE_EQ(ratio, 0.5);
+
+    bool ok;
+    ASSERT_TRUE(json.get("ok", ok));
+    EXPECT_TRUE(ok);
+}
+
+TEST(TestJsonPayload, MissingOrMismatched) {
+    JsonPayload json(R"({"id": "42"})");
+
+    int64_t id;
+    EXPECT_FALSE(json.get("id", id));
+    EXPECT_FALSE(json.get("missing", id));
+
+    std::string s;
+    EXPECT_TRUE(json.get("id", s));
+    EXPECT_EQ(s, "42");
+}
+
+TEST(TestJsonPayload, PaddedInPlace) {
+    std::string data = R"({"msg": "hello"})";
+    data.reserve(data.size() + JsonPayload::Padding);
+
+    JsonPayload json(data);
+    std::string msg;
+    ASSERT_TRUE(json.get("msg", msg));
+    EXPECT_EQ(msg, "hello");
+}
+
+TEST(TestJsonPayload, NotAnObject) {
+    JsonPayload json("[1, 2, 3]");
+
+    int64_t v;
+    EXPECT_FALSE(json.get("0", v));
+}
+
+struct Order {
+    int64_t id;
+};
+
+TEST(TestJsonPayload, TypedHandlerThroughPoll) {
+    Protocon::TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    auto gateway = Protocon::GatewayBuilder(1)
+                       .withTransportProfile(profile)
+                       .withTypedRequestHandler<Order>(
+                           0x0001,
+                           [](JsonPayload& json, Order& order) { return json.get("id", order.id); },
+                           [](ClientToken, const Request&, const Order& order) {
+                               return Response{0, 0x00, std::to_string(order.id)};
+                           })
+                       .build();
+    gateway.createClientToken(2);
+
+    Protocon::ScriptedServer server;
+    server.serve(Protocon::Wire::RequestFrame(1, 2, 0x0001, 0, R"({"id": 7})") +
+                 Protocon::Wire::RequestFrame(2, 2, 0x0001, 0, R"({"id": "7"})") +
+                 Protocon::Wire::RequestFrame(3, 2, 0x0001, 0, "{"));
+
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (server.responses(0).size() < 3 && std::chrono::steady_clock::now() < deadline) {
+        gateway.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    gateway.stop();
+
+    const uint8_t invalid = Protocon::InvalidPayloadStatus;
+    auto responses = server.responses(3);
+    ASSERT_EQ(responses.size(), 3u);
+    EXPECT_EQ(responses[0].second.status, 0x00);
+    EXPECT_EQ(responses[0].second.data, "7");
+    // Mismatched field and malformed JSON never reach the handler
+    EXPECT_EQ(responses[1].second.status, invalid);
+    EXPECT_EQ(responses[2].second.status, invalid);
+    EXPECT_TRUE(responses[2].second.data.empty());
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FakeTransport.h"
+#include "FramePool.h"
+#include "RawCommand.h"
+#include "Sender.h"
+#include "ThreadSafeQueue.h"
+#include "Transport.h"
+#include "Util.h"
+
+using namespace Protocon;
+
+TEST(TestPayloadWriter, PoolRecyclesBuffers) {
+    auto pool = std::make_shared<FramePool>();
+
+    const char* data;
+    {
+        PayloadWriter writer = pool->acquire();
+        writer.append(std::string(1000, 'x'));
+        EXPECT_EQ(writer.size(), 1000u);
+        EXPECT_EQ(std::string(writer.data(), 3), "xxx");
+        data = writer.data();
+    }
+
+    PayloadWriter writer = pool->acquire();
+    EXPECT_EQ(writer.size(), 0u);
+    // Same buffer, no new allocation
+    EXPECT_EQ(writer.data(), data);
+}
+
+TEST(TestPayloadWriter, LargePayloadIsWrittenInPlace) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+    ThreadSafeQueue<RawSignUpRequest> signUpRequests;
+    ThreadSafeQueue<RawSignInRequest> signInRequests;
+
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+
+    FakeTransport transport;
+    Sender sender(transport, requests, responses, signUpRequests, signInRequests, profile);
+
+    auto pool = std::make_shared<FramePool>();
+    PayloadWriter payload = pool->acquire();
+    std::string body(1 << 20, 'y');
+    payload.append(body);
+    const char* payloadData = payload.data();
+
+    responses.emplace(RawResponse{7, Response{0, 0x00, "{}"}});
+    responses.emplace(RawResponse{8, Response{0, 0x01, ""}, std::move(payload)});
+
+    // Keep the payload out of the test log
+    auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+
+    sender.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sender.stop();
+
+    spdlog::set_level(level);
+
+    auto writes = transport.writes();
+    ASSERT_EQ(writes.size(), 2u);
+
+    // The small response is batched as usual, the large one follows it
+    EXPECT_EQ(writes[0].data.size(), 16u + 2);
+    EXPECT_TRUE(writes[0].more);
+    EXPECT_FALSE(writes[1].more);
+
+    // The large one goes out from the writer's own buffer, header in front
+    const std::size_t headerSize = 16;
+    ASSERT_EQ(writes[1].data.size(), headerSize + body.size());
+    EXPECT_EQ(writes[1].buf + headerSize, payloadData);
+    EXPECT_EQ(uint8_t(writes[1].data[0]), 0x80);
+    EXPECT_EQ(uint8_t(writes[1].data[11]), 0x01);
+
+    uint32_t length;
+    std::memcpy(&length, writes[1].data.data() + 12, sizeof(length));
+    EXPECT_EQ(Util::BigEndian(length), body.size());
+    EXPECT_EQ(writes[1].data.substr(headerSize), body);
+}
+
+TEST(TestPayloadWriter, BroadcastSharesOnePayload) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+    ThreadSafeQueue<RawSignUpRequest> signUpRequests;
+    ThreadSafeQueue<RawSignInRequest> signInRequests;
+
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+
+    FakeTransport transport;
+    Sender sender(transport, requests, responses, signUpRequests, signInRequests, profile);
+
+    auto pool = std::make_shared<FramePool>();
+    auto payload = std::make_shared<PayloadWriter>(pool->acquire());
+    std::string body(64 << 10, 'z');
+    payload->append(body);
+
+    for (uint16_t i = 0; i < 3; i++)
+        requests.emplace(RawRequest{i, 1, 100u + i, 2, Request{0, 0x0001, ""}, PayloadWriter(), payload});
+
+    auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+
+    sender.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sender.stop();
+
+    spdlog::set_level(level);
+
+    // Every frame goes out of the same buffer, with its own header
+    auto writes = transport.writes();
+    ASSERT_EQ(writes.size(), 3u);
+    const std::size_t headerSize = 35;
+    for (uint16_t i = 0; i < 3; i++) {
+        ASSERT_EQ(writes[i].data.size(), headerSize + body.size());
+        EXPECT_EQ(writes[i].buf + headerSize, payload->data());
+
+        uint16_t cmdId;
+        std::memcpy(&cmdId, writes[i].data.data() + 1, sizeof(cmdId));
+        EXPECT_EQ(Util::BigEndian(cmdId), i);
+
+        uint64_t clientId;
+        std::memcpy(&clientId, writes[i].data.data() + 11, sizeof(clientId));
+        EXPECT_EQ(Util::BigEndian(clientId), 100u + i);
+    }
+}
+
+TEST(TestPayloadWriter, FullBatchWithNothingBehindIsNotCorked) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+    ThreadSafeQueue<RawSignUpRequest> signUpRequests;
+    ThreadSafeQueue<RawSignInRequest> signInRequests;
+
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    profile.maxBatchBytes = 64;
+
+    FakeTransport transport;
+    Sender sender(transport, requests, responses, signUpRequests, signInRequests, profile);
+
+    // Three frames fill two batches
+    for (uint16_t i = 0; i < 3; i++)
+        responses.emplace(RawResponse{i, Response{0, 0x00, std::string(20, 'r')}});
+
+    auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+
+    sender.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    sender.stop();
+
+    spdlog::set_level(level);
+
+    auto writes = transport.writes();
+    ASSERT_EQ(writes.size(), 2u);
+    EXPECT_TRUE(writes[0].more);
+    EXPECT_FALSE(writes[1].more);
+}
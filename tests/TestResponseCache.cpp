@@ -0,0 +1,102 @@
+#include <Protocon/Protocon.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include "ResponseCache.h"
+#include "ScriptedServer.h"
+
+using Protocon::ClientToken;
+using Protocon::Request;
+using Protocon::Response;
+using Protocon::ResponseCache;
+
+TEST(TestResponseCache, HitAndMiss) {
+    ResponseCache cache(std::chrono::seconds(10), 8);
+    EXPECT_EQ(cache.find("{}"), nullptr);
+
+    cache.insert("{}", Response{0, 0x00, "ok"});
+    ASSERT_NE(cache.find("{}"), nullptr);
+    EXPECT_EQ(cache.find("{}")->data, "ok");
+    EXPECT_EQ(cache.find("{ }"), nullptr);
+}
+
+TEST(TestResponseCache, ExpiresAfterTtl) {
+    auto now = ResponseCache::Clock::now();
+    ResponseCache cache(std::chrono::seconds(1), 8);
+
+    cache.insert("a", Response{0, 0x00, "a"}, now);
+    EXPECT_NE(cache.find("a", now + std::chrono::milliseconds(500)), nullptr);
+    EXPECT_EQ(cache.find("a", now + std::chrono::seconds(1)), nullptr);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(TestResponseCache, EvictsLeastRecentlyUsed) {
+    ResponseCache cache(std::chrono::seconds(10), 2);
+
+    cache.insert("a", Response{0, 0x00, "a"});
+    cache.insert("b", Response{0, 0x00, "b"});
+    cache.find("a");
+    cache.insert("c", Response{0, 0x00, "c"});
+
+    EXPECT_NE(cache.find("a"), nullptr);
+    EXPECT_EQ(cache.find("b"), nullptr);
+    EXPECT_NE(cache.find("c"), nullptr);
+}
+
+TEST(TestResponseCache, Invalidate) {
+    ResponseCache cache(std::chrono::seconds(10), 8);
+
+    cache.insert("a", Response{0, 0x00, "a"});
+    cache.insert("b", Response{0, 0x00, "b"});
+    cache.erase("a");
+    EXPECT_EQ(cache.find("a"), nullptr);
+    EXPECT_NE(cache.find("b"), nullptr);
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(TestResponseCache, GatewayCachesSuccessOnly) {
+    int calls = 0;
+    Protocon::TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    auto gateway = Protocon::GatewayBuilder(1)
+                       .withTransportProfile(profile)
+                       .withRequestHandler(0x0001, [&calls](ClientToken, const Request&) {
+                           // Fails once, then succeeds
+                           return Response{1, static_cast<uint8_t>(calls++ ? 0x00 : 0x01), "ok"};
+                       })
+                       .withResponseCache(0x0001, std::chrono::seconds(10), 16)
+                       .build();
+    gateway.createClientToken(2);
+
+    const uint64_t start = static_cast<uint64_t>(std::time(nullptr));
+    Protocon::ScriptedServer server;
+    std::string stream;
+    for (uint16_t i = 0; i < 3; i++)
+        stream += Protocon::Wire::RequestFrame(i, 2, 0x0001, 0, "{}");
+    server.serve(stream);
+
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (server.responses(0).size() < 3 && std::chrono::steady_clock::now() < deadline) {
+        gateway.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    gateway.stop();
+
+    auto responses = server.responses(3);
+    ASSERT_EQ(responses.size(), 3u);
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(responses[0].second.status, 0x01);
+    EXPECT_EQ(responses[1].second.status, 0x00);
+    EXPECT_EQ(responses[1].second.time, 1u);
+    // Served from the cache, stamped when it was served
+    EXPECT_EQ(responses[2].second.status, 0x00);
+    EXPECT_EQ(responses[2].second.data, "ok");
+    EXPECT_GE(responses[2].second.time, start);
+}
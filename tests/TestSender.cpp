@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FakeTransport.h"
+#include "RawCommand.h"
+#include "Sender.h"
+#include "ThreadSafeQueue.h"
+#include "Util.h"
+
+using namespace Protocon;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Frame {
+    uint8_t flag;
+    uint64_t clientId;
+};
+
+template <typename T>
+T get(const std::string& data, std::size_t offset) {
+    T v;
+    std::memcpy(&v, data.data() + offset, sizeof(v));
+    return Util::BigEndian(v);
+}
+
+// Splits what the Sender wrote into frames, keeping the client ID of requests
+std::vector<Frame> frames(const std::string& data) {
+    std::vector<Frame> result;
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        uint8_t flag = static_cast<uint8_t>(data[offset]);
+        if (flag == 0x00) {
+            result.push_back(Frame{flag, get<uint64_t>(data, offset + 11)});
+            offset += 35 + get<uint32_t>(data, offset + 31);
+        } else if (flag == 0x80) {
+            result.push_back(Frame{flag, 0});
+            offset += 16 + get<uint32_t>(data, offset + 12);
+        } else if (flag == 0x02) {
+            result.push_back(Frame{flag, 0});
+            offset += 19;
+        } else {
+            ADD_FAILURE() << "Unexpected flag " << int(flag);
+            break;
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST(TestSender, LanesAndFairness) {
+    ThreadSafeQueue<RawRequest> requests;
+    ThreadSafeQueue<RawResponse> responses;
+    ThreadSafeQueue<RawSignUpRequest> signUpRequests;
+    ThreadSafeQueue<RawSignInRequest> signInRequests;
+
+    // Each request uses most of a client's credit for one round, one busy
+    // client queued ahead of another
+    const std::string payload(3000, 'x');
+    for (uint16_t i = 0; i < 3; i++)
+        requests.emplace(RawRequest{i, 1, 10, 1, Request{0, 0x0001, payload}});
+    for (uint16_t i = 3; i < 6; i++)
+        requests.emplace(RawRequest{i, 1, 20, 1, Request{0, 0x0001, payload}});
+    // Queued behind the backlog, written ahead of it
+    responses.emplace(RawResponse{9, Response{0, 0x00, "{}"}});
+    signInRequests.emplace(RawSignInRequest{7, 1, 10});
+
+    TransportProfile profile;
+    profile.idleInterval = 1ms;
+    FakeTransport transport;
+    Sender sender(transport, requests, responses, signUpRequests, signInRequests, profile);
+
+    auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+    sender.run();
+    std::this_thread::sleep_for(50ms);
+    sender.stop();
+    spdlog::set_level(level);
+
+    auto written = frames(transport.written());
+    ASSERT_EQ(written.size(), 8u);
+    EXPECT_EQ(written[0].flag, 0x02);
+    EXPECT_EQ(written[1].flag, 0x80);
+
+    // The clients take turns instead of the first one draining its backlog
+    const uint64_t expected[] = {10, 20, 10, 20, 10, 20};
+    for (std::size_t i = 0; i < 6; i++) {
+        EXPECT_EQ(written[2 + i].flag, 0x00);
+        EXPECT_EQ(written[2 + i].clientId, expected[i]);
+    }
+}
@@ -0,0 +1,122 @@
+#ifdef __linux__
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "ShmTransport.h"
+
+using Protocon::ShmTransport;
+using namespace std::chrono_literals;
+
+static const char* SegmentName = "/protocon-test-shm";
+
+// Reads exactly n bytes unless the ring is closed first
+static std::string ReadAll(ShmTransport& transport, std::size_t n) {
+    std::string data(n, '\0');
+    std::size_t offset = 0;
+    while (offset < n) {
+        std::size_t len = transport.read(&data[offset], n - offset);
+        if (!len) break;
+        offset += len;
+    }
+    data.resize(offset);
+    return data;
+}
+
+class TestShmTransport : public testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_TRUE(mServer.listen(SegmentName, 64));
+        ASSERT_TRUE(mGateway.connect(SegmentName, 0));
+        mServer.accept();
+    }
+
+    ShmTransport mServer;
+    ShmTransport mGateway;
+};
+
+TEST_F(TestShmTransport, Wraparound) {
+    // Many times the ring capacity, in writes that straddle its end
+    std::string data;
+    for (int i = 0; i < 1000; i++)
+        data += static_cast<char>('a' + i % 26);
+
+    std::thread writer([&] {
+        for (std::size_t offset = 0; offset < data.size(); offset += 37)
+            ASSERT_TRUE(mGateway.write(data.data() + offset, std::min<std::size_t>(37, data.size() - offset), false));
+    });
+    EXPECT_EQ(ReadAll(mServer, data.size()), data);
+    writer.join();
+}
+
+TEST_F(TestShmTransport, WakeUp) {
+    std::string received;
+    std::thread reader([&] { received = ReadAll(mGateway, 3); });
+
+    // The reader is asleep on an empty ring by now
+    std::this_thread::sleep_for(20ms);
+    EXPECT_FALSE(mGateway.readable());
+    ASSERT_TRUE(mServer.write("abc", 3, false));
+    reader.join();
+    EXPECT_EQ(received, "abc");
+}
+
+TEST_F(TestShmTransport, Shutdown) {
+    std::size_t len = 1;
+    std::thread reader([&] {
+        char c;
+        len = mGateway.read(&c, 1);
+    });
+
+    std::this_thread::sleep_for(20ms);
+    EXPECT_TRUE(mGateway.is_open());
+    mGateway.shutdown();
+    reader.join();
+
+    // A blocked read returns EOF, the server can't write any more
+    EXPECT_EQ(len, 0u);
+    EXPECT_FALSE(mGateway.is_open());
+    EXPECT_FALSE(mServer.write("abc", 3, false));
+}
+
+TEST_F(TestShmTransport, ShutdownSend) {
+    ASSERT_TRUE(mServer.write("abc", 3, false));
+    mServer.shutdownSend();
+
+    // Data still in the ring is read before EOF
+    EXPECT_EQ(ReadAll(mGateway, 4), "abc");
+    EXPECT_TRUE(mGateway.write("d", 1, false));
+    EXPECT_EQ(ReadAll(mServer, 1), "d");
+}
+
+TEST_F(TestShmTransport, Reattach) {
+    // The segment already has its gateway
+    ShmTransport second;
+    EXPECT_FALSE(second.connect(SegmentName, 0));
+    EXPECT_FALSE(second.is_open());
+}
+
+TEST(TestShmTransportSegment, GoneWithTheServer) {
+    {
+        ShmTransport server;
+        ASSERT_TRUE(server.listen(SegmentName, 64));
+    }
+
+    ShmTransport gateway;
+    EXPECT_FALSE(gateway.connect(SegmentName, 0));
+
+    // A new server gets a fresh segment under the same name
+    ShmTransport server;
+    ASSERT_TRUE(server.listen(SegmentName, 64));
+    EXPECT_TRUE(gateway.connect(SegmentName, 0));
+}
+
+TEST(TestShmTransportSegment, CapacityPowerOfTwo) {
+    ShmTransport server;
+    EXPECT_FALSE(server.listen(SegmentName, 100));
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "FramePool.h"
+#include "RawCommand.h"
+#include "SpillQueue.h"
+
+using namespace Protocon;
+
+static RawRequest MakeRequest(uint16_t cmdId, std::string data) {
+    return RawRequest{cmdId, 1, 2, 3, Request{4, 0x0001, std::move(data)}};
+}
+
+static bool Exists(const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (f) std::fclose(f);
+    return f;
+}
+
+TEST(TestSpillQueue, InOrderAcrossSegments) {
+    std::string directory = testing::TempDir() + "TestSpillQueue";
+    SpillQueue spill(directory, 256);
+    ASSERT_TRUE(spill.open());
+
+    // A few records per segment, and one larger than a segment
+    for (uint16_t i = 0; i < 100; i++)
+        ASSERT_TRUE(spill.push(MakeRequest(i, std::string(i == 50 ? 1000 : 40, 'a' + i % 26))));
+    EXPECT_EQ(spill.size(), 100u);
+    EXPECT_TRUE(Exists(directory + "/spill-1.log"));
+
+    RawRequest r;
+    for (uint16_t i = 0; i < 100; i++) {
+        ASSERT_TRUE(spill.pop(r));
+        EXPECT_EQ(r.cmdId, i);
+        EXPECT_EQ(r.gatewayId, 1u);
+        EXPECT_EQ(r.clientId, 2u);
+        EXPECT_EQ(r.apiVersion, 3);
+        EXPECT_EQ(r.request.time, 4u);
+        EXPECT_EQ(r.request.type, 0x0001);
+        EXPECT_EQ(r.request.data, std::string(i == 50 ? 1000 : 40, 'a' + i % 26));
+    }
+    EXPECT_FALSE(spill.pop(r));
+    EXPECT_EQ(spill.size(), 0u);
+
+    // Drained segments are gone
+    EXPECT_FALSE(Exists(directory + "/spill-1.log"));
+}
+
+TEST(TestSpillQueue, Interleaved) {
+    SpillQueue spill(testing::TempDir() + "TestSpillQueue", 128);
+    ASSERT_TRUE(spill.open());
+
+    RawRequest r;
+    uint16_t next = 0;
+    for (uint16_t i = 0; i < 200; i++) {
+        ASSERT_TRUE(spill.push(MakeRequest(i, std::to_string(i))));
+        if (i % 3 == 2) {
+            ASSERT_TRUE(spill.pop(r));
+            EXPECT_EQ(r.cmdId, next);
+            EXPECT_EQ(r.request.data, std::to_string(next));
+            next++;
+        }
+    }
+
+    while (spill.pop(r))
+        EXPECT_EQ(r.cmdId, next++);
+    EXPECT_EQ(next, 200);
+}
+
+TEST(TestSpillQueue, PayloadWriter) {
+    SpillQueue spill(testing::TempDir() + "TestSpillQueue");
+    ASSERT_TRUE(spill.open());
+
+    auto pool = std::make_shared<FramePool>();
+    RawRequest request = MakeRequest(7, "");
+    request.payload = pool->acquire();
+    request.payload.append(std::string("{\"k\": 1}"));
+    ASSERT_TRUE(spill.push(request));
+
+    // Spilled payloads come back as plain data
+    RawRequest r;
+    ASSERT_TRUE(spill.pop(r));
+    EXPECT_EQ(r.request.data, "{\"k\": 1}");
+    EXPECT_EQ(r.payload.size(), 0u);
+}
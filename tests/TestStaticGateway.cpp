@@ -0,0 +1,99 @@
+#include <Protocon/StaticGateway.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <ctime>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "ScriptedServer.h"
+
+using namespace Protocon;
+
+static Response Reply(uint8_t status) {
+    return Response{0, status, ""};
+}
+
+TEST(TestStaticGateway, Dispatch) {
+    int calls = 0;
+    auto first = [&calls](ClientToken, const Request&) { calls++; return Reply(1); };
+    auto second = [&calls](ClientToken, const Request& r) { calls++; return Reply(static_cast<uint8_t>(r.data.size())); };
+
+    using First = StaticDispatcher<0x0001, decltype(first), StaticDispatchEnd>;
+    using Second = StaticDispatcher<0x0002, decltype(second), First>;
+    Second dispatcher(second, First(first, StaticDispatchEnd()));
+
+    static_assert(Second::Handles(0x0001) && Second::Handles(0x0002) && !Second::Handles(0x0003),
+                  "Handled types are known at compile time");
+
+    Response response;
+    dispatcher.dispatch(ClientToken{0}, Request{0, 0x0001, ""}, response);
+    EXPECT_EQ(response.status, 1);
+    dispatcher.dispatch(ClientToken{0}, Request{0, 0x0002, "abc"}, response);
+    EXPECT_EQ(response.status, 3);
+    EXPECT_EQ(calls, 2);
+}
+
+TEST(TestStaticGateway, Builder) {
+    auto gateway = GatewayBuilder(1)
+                       .withTracing()
+                       .withRequestHandler(0x0003, [](ClientToken, const Request&) { return Reply(3); })
+                       .withHandler<0x0001>([](ClientToken, const Request&) { return Reply(1); })
+                       .withHandler<0x0002>([](ClientToken, const Request&) { return Reply(2); })
+                       .build();
+
+    static_assert(std::is_base_of<Gateway, decltype(gateway)>::value, "Still a Gateway");
+    EXPECT_FALSE(gateway.isOpen());
+}
+
+TEST(TestStaticGateway, Poll) {
+    int staticCalls = 0;
+    int mapCalls = 0;
+
+    TransportProfile profile;
+    profile.idleInterval = std::chrono::milliseconds(1);
+    AdmissionOptions admission;
+    admission.maxRequestAge = std::chrono::seconds(10);
+    admission.busyStatus = 0x42;
+
+    auto gateway = GatewayBuilder(1)
+                       .withTransportProfile(profile)
+                       .withAdmissionControl(admission)
+                       .withRequestHandler(0x0002, [&mapCalls](ClientToken, const Request&) { mapCalls++; return Reply(0x22); })
+                       .withRequestHandler(0x0003, [&mapCalls](ClientToken, const Request&) { mapCalls++; return Reply(3); })
+                       .withHandler<0x0001>([&staticCalls](ClientToken, const Request&) { staticCalls++; return Reply(1); })
+                       .withHandler<0x0002>([&staticCalls](ClientToken, const Request&) { staticCalls++; return Reply(2); })
+                       .build();
+    gateway.createClientToken(2);
+
+    const uint64_t now = static_cast<uint64_t>(std::time(nullptr));
+    std::string stream = Wire::RequestFrame(1, 2, 0x0001, now, "{}") +
+                         Wire::RequestFrame(2, 2, 0x0002, now, "{}") +
+                         Wire::RequestFrame(3, 2, 0x0003, now, "{}") +
+                         // Admitted by the Receiver, but too old once poll() gets to it
+                         Wire::RequestFrame(4, 2, 0x0001, now - 9, "{}");
+
+    ScriptedServer server;
+    server.serve(stream);
+    ASSERT_TRUE(gateway.run("127.0.0.1", server.port()));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (server.responses(0).size() < 4 && std::chrono::steady_clock::now() < deadline) {
+        gateway.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    gateway.stop();
+
+    std::map<uint16_t, uint8_t> statuses;
+    for (const auto& r : server.responses(4))
+        statuses[r.first] = r.second.status;
+
+    EXPECT_EQ(statuses, (std::map<uint16_t, uint8_t>{{1, 1}, {2, 2}, {3, 3}, {4, 0x42}}));
+    // The static handler wins over the map for type 0x0002
+    EXPECT_EQ(staticCalls, 2);
+    EXPECT_EQ(mapCalls, 1);
+    EXPECT_EQ(gateway.shedRequests(), 1u);
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "Backoff.h"
+#include "ThreadPlacement.h"
+
+using namespace Protocon;
+
+#ifdef __linux__
+TEST(TestThreadPlacement, NameAndAffinity) {
+    cpu_set_t allowed;
+    ASSERT_EQ(::sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+        cpu++;
+
+    std::string name;
+    cpu_set_t set;
+    std::thread t([&] {
+        ThreadOptions options;
+        options.cpu = cpu;
+        options.name = "protocon-test-thread";
+        ThreadPlacement::Apply(options);
+
+        char buf[16];
+        ::pthread_getname_np(::pthread_self(), buf, sizeof(buf));
+        name = buf;
+        ::sched_getaffinity(0, sizeof(set), &set);
+    });
+    t.join();
+
+    // Truncated to what the kernel takes
+    EXPECT_EQ(name, "protocon-test-t");
+    EXPECT_EQ(CPU_COUNT(&set), 1);
+    EXPECT_TRUE(CPU_ISSET(cpu, &set));
+}
+
+TEST(TestThreadPlacement, CpuOutOfRange) {
+    cpu_set_t allowed;
+    ASSERT_EQ(::sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+
+    cpu_set_t set;
+    std::thread t([&] {
+        ThreadOptions options;
+        options.cpu = CPU_SETSIZE + 1;
+        ThreadPlacement::Apply(options);
+
+        ::sched_getaffinity(0, sizeof(set), &set);
+    });
+    t.join();
+
+    // Left alone
+    EXPECT_TRUE(CPU_EQUAL(&set, &allowed));
+}
+#endif
+
+TEST(TestThreadPlacement, BackoffSleepsOnceSpinningRunsOut) {
+    Backoff backoff(std::chrono::microseconds(100));
+
+    int spins = 0;
+    while (backoff.spin())
+        spins++;
+    EXPECT_GT(spins, 0);
+    EXPECT_FALSE(backoff.spin());
+
+    // Sleeps are capped
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; i++)
+        backoff.idle();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+    backoff.reset();
+    EXPECT_TRUE(backoff.spin());
+}
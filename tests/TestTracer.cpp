@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Tracer.h"
+
+using Protocon::TraceHistogram;
+using Protocon::Tracer;
+using Protocon::TraceStage;
+
+static const TraceHistogram* Find(const std::vector<TraceHistogram>& histograms, const std::string& hop) {
+    for (const auto& h : histograms)
+        if (h.hop == hop) return &h;
+    return nullptr;
+}
+
+TEST(TestTracer, Histograms) {
+    Tracer tracer(64);
+    const uint32_t key = Tracer::Key(Tracer::Outbound, 7);
+
+    // Two spans of the same command ID, the second one after a wrap around
+    for (uint64_t base : {1000, 5000}) {
+        tracer.record(Tracer::User, key, TraceStage::Enqueue, base);
+        tracer.record(Tracer::Sender, key, TraceStage::Dequeue, base + 10);
+        tracer.record(Tracer::Sender, key, TraceStage::Write, base + 30);
+        tracer.record(Tracer::Receiver, key, TraceStage::Parse, base + 100);
+        tracer.record(Tracer::User, key, TraceStage::Dispatch, base + 150);
+        tracer.record(Tracer::User, key, TraceStage::Complete, base + 151);
+    }
+
+    const uint32_t inbound = Tracer::Key(Tracer::Inbound, 7);
+    tracer.record(Tracer::Receiver, inbound, TraceStage::Parse, 2000);
+    tracer.record(Tracer::User, inbound, TraceStage::Dispatch, 2004);
+
+    auto histograms = tracer.histograms();
+
+    const TraceHistogram* h = Find(histograms, "request/enqueue->dequeue");
+    ASSERT_NE(h, nullptr);
+    EXPECT_EQ(h->count, 2u);
+    EXPECT_EQ(h->min, 10u);
+    EXPECT_EQ(h->p99, 10u);
+    // 10 is in [8, 16)
+    ASSERT_EQ(h->buckets.size(), 5u);
+    EXPECT_EQ(h->buckets[4], 2u);
+
+    h = Find(histograms, "request/total");
+    ASSERT_NE(h, nullptr);
+    EXPECT_EQ(h->max, 151u);
+
+    h = Find(histograms, "server_request/parse->dispatch");
+    ASSERT_NE(h, nullptr);
+    EXPECT_EQ(h->count, 1u);
+    EXPECT_EQ(h->p50, 4u);
+
+    EXPECT_EQ(Find(histograms, "server_request/dispatch->complete"), nullptr);
+}
+
+TEST(TestTracer, DropsWhenFull) {
+    Tracer tracer(2);
+    for (uint16_t i = 0; i < 4; i++)
+        tracer.record(Tracer::User, Tracer::Key(Tracer::Outbound, i), TraceStage::Enqueue);
+
+    EXPECT_EQ(tracer.dropped(), 2u);
+}
+
+TEST(TestTracer, ChromeTrace) {
+    Tracer tracer(16);
+    const uint32_t key = Tracer::Key(Tracer::Inbound, 3);
+    tracer.record(Tracer::Receiver, key, TraceStage::Parse, 1000);
+    tracer.record(Tracer::User, key, TraceStage::Dispatch, 3500);
+
+    std::string path = testing::TempDir() + "TestTracer.json";
+    ASSERT_TRUE(tracer.writeChromeTrace(path));
+
+    std::ifstream f(path);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string json = ss.str();
+
+    EXPECT_NE(json.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"parse->dispatch\",\"cat\":\"server_request\",\"ph\":\"X\",\"ts\":0.000,\"dur\":2.500,\"pid\":1,\"tid\":0"), std::string::npos);
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <asio/io_context.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/read.hpp>
+#include <asio/write.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Socket.h"
+
+#ifdef PROTOCON_IO_URING
+#include "UringTransport.h"
+#endif
+
+using namespace Protocon;
+using namespace std::chrono_literals;
+
+// The TCP transports against a plain asio server
+template <typename T>
+class TestTransport : public testing::Test {
+  protected:
+    TestTransport()
+        : mAcceptor(mContext, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0)),
+          mServer(mContext) {}
+
+    std::unique_ptr<T> connect(const TransportProfile& profile) {
+        auto transport = std::make_unique<T>(profile);
+        std::thread server([this] { mAcceptor.accept(mServer); });
+        bool connected = transport->connect("127.0.0.1", mAcceptor.local_endpoint().port());
+        server.join();
+        return connected ? std::move(transport) : nullptr;
+    }
+
+    std::string read(Transport& transport, std::size_t n) {
+        std::string data(n, '\0');
+        std::size_t offset = 0;
+        while (offset < n) {
+            std::size_t len = transport.read(&data[offset], n - offset);
+            if (!len) break;
+            offset += len;
+        }
+        data.resize(offset);
+        return data;
+    }
+
+    asio::io_context mContext;
+    asio::ip::tcp::acceptor mAcceptor;
+    asio::ip::tcp::socket mServer;
+};
+
+#ifdef PROTOCON_IO_URING
+using Transports = testing::Types<Socket, UringTransport>;
+#else
+using Transports = testing::Types<Socket>;
+#endif
+TYPED_TEST_SUITE(TestTransport, Transports);
+
+TYPED_TEST(TestTransport, RoundTrip) {
+    auto transport = this->connect(TransportProfile());
+    ASSERT_TRUE(transport);
+
+    ASSERT_TRUE(transport->write("abc", 3, false));
+    std::string received(3, '\0');
+    asio::read(this->mServer, asio::buffer(&received[0], received.size()));
+    EXPECT_EQ(received, "abc");
+
+    asio::write(this->mServer, asio::buffer("xyz", 3));
+    EXPECT_EQ(this->read(*transport, 3), "xyz");
+}
+
+TYPED_TEST(TestTransport, ShutdownSend) {
+    auto transport = this->connect(TransportProfile());
+    ASSERT_TRUE(transport);
+
+    ASSERT_TRUE(transport->write("abc", 3, false));
+    transport->shutdownSend();
+
+    std::string received;
+    std::array<char, 16> buf;
+    asio::error_code ec;
+    while (!ec) {
+        std::size_t len = this->mServer.read_some(asio::buffer(buf), ec);
+        received.append(buf.data(), len);
+    }
+    EXPECT_EQ(ec, asio::error::eof);
+    EXPECT_EQ(received, "abc");
+}
+
+// Small socket buffers and a slow reader make the kernel accept only part
+// of each send, every byte must still arrive exactly once and in order
+TYPED_TEST(TestTransport, ShortSends) {
+    std::string data(1 << 20, '\0');
+    for (std::size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i % 251);
+
+    for (bool cork : {false, true}) {
+        TransportProfile profile;
+        profile.cork = cork;
+        profile.sendBufferSize = 16 << 10;
+        auto transport = this->connect(profile);
+        ASSERT_TRUE(transport);
+
+        std::string received;
+        std::thread reader([this, &received] {
+            std::array<char, 4096> buf;
+            asio::error_code ec;
+            while (!ec) {
+                std::size_t len = this->mServer.read_some(asio::buffer(buf), ec);
+                received.append(buf.data(), len);
+                if (received.size() % (64 << 10) < len) std::this_thread::sleep_for(1ms);
+            }
+        });
+
+        // Several chains' worth with more set, then the tail
+        EXPECT_TRUE(transport->write(data.data(), data.size() - 100, true));
+        EXPECT_TRUE(transport->write(data.data() + data.size() - 100, 100, false));
+        transport->shutdownSend();
+        reader.join();
+
+        EXPECT_EQ(received.size(), data.size());
+        EXPECT_TRUE(received == data) << "cork: " << cork;
+
+        this->mServer.close();
+    }
+}
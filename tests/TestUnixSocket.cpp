@@ -0,0 +1,85 @@
+#ifndef _WIN32
+
+#include <gtest/gtest.h>
+
+#include <asio/io_context.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "Socket.h"
+
+using Protocon::UnixSocket;
+using namespace std::chrono_literals;
+
+class TestUnixSocket : public testing::Test {
+  protected:
+    void SetUp() override {
+        std::remove(mPath.c_str());
+        asio::local::stream_protocol::acceptor acceptor(mContext, asio::local::stream_protocol::endpoint(mPath));
+
+        std::thread server([&] { acceptor.accept(mServer.socket()); });
+        ASSERT_TRUE(mGateway.connect(mPath.c_str(), 0));
+        server.join();
+    }
+
+    void TearDown() override { std::remove(mPath.c_str()); }
+
+    std::string read(UnixSocket& socket, std::size_t n) {
+        std::string data(n, '\0');
+        std::size_t offset = 0;
+        while (offset < n) {
+            std::size_t len = socket.read(&data[offset], n - offset);
+            if (!len) break;
+            offset += len;
+        }
+        data.resize(offset);
+        return data;
+    }
+
+    std::string mPath = testing::TempDir() + "protocon-test.sock";
+    asio::io_context mContext;
+    UnixSocket mServer;
+    UnixSocket mGateway;
+};
+
+TEST_F(TestUnixSocket, RoundTrip) {
+    ASSERT_TRUE(mGateway.write("abc", 3, true));
+    ASSERT_TRUE(mGateway.write("def", 3, false));
+    EXPECT_EQ(read(mServer, 6), "abcdef");
+
+    ASSERT_TRUE(mServer.write("xyz", 3, false));
+    EXPECT_EQ(read(mGateway, 3), "xyz");
+}
+
+TEST_F(TestUnixSocket, ShutdownSend) {
+    ASSERT_TRUE(mServer.write("abc", 3, false));
+    mServer.shutdownSend();
+
+    // Pending data first, then EOF, while the other direction stays usable
+    EXPECT_EQ(read(mGateway, 4), "abc");
+    ASSERT_TRUE(mGateway.write("d", 1, false));
+    EXPECT_EQ(read(mServer, 1), "d");
+}
+
+TEST_F(TestUnixSocket, ShutdownWakesReader) {
+    std::size_t len = 1;
+    std::thread reader([&] {
+        char c;
+        len = mGateway.read(&c, 1);
+    });
+
+    std::this_thread::sleep_for(20ms);
+    mGateway.shutdown();
+    reader.join();
+    EXPECT_EQ(len, 0u);
+}
+
+TEST(TestUnixSocketConnect, NoServer) {
+    UnixSocket socket;
+    EXPECT_FALSE(socket.connect((testing::TempDir() + "protocon-missing.sock").c_str(), 0));
+}
+
+#endif
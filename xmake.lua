@@ -5,19 +5,33 @@ set_xmakever("2.5.9")
 
 add_requires("spdlog v1.9.2")
 add_requires("asio 1.20.0")
+add_requires("simdjson")
 
 set_warnings("all", "error")
 set_languages("cxx14")
 
 add_rules("mode.debug", "mode.release")
 
+option("io_uring")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the Linux io_uring transport backend")
+    add_defines("PROTOCON_IO_URING")
+option_end()
+
 target("Protocon")
     set_kind("static")
     add_files("src/*.cpp")
     add_includedirs("include", { public = true })
     add_packages("spdlog")
     add_packages("asio")
+    add_packages("simdjson", { public = true })
     add_headerfiles("include/(Protocon/*.h)")
+    if is_plat("linux") then
+        add_options("io_uring")
+        -- shm_open() for the shared memory transport
+        add_syslinks("rt", { public = true })
+    end
 
 includes("tests")
 includes("benches")